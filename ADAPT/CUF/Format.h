@@ -70,6 +70,8 @@
 
 #include <sstream>
 #include <cstddef>
+#include <cstdio>
+#include <string>
 #include <cctype>
 #include <type_traits>
 #include <exception>
@@ -718,6 +720,33 @@ void Print(FILE* fp, Args&& ...args)
 	Apply(&fprintf, std::tuple_cat(std::make_tuple(fp), std::make_tuple(fmt.data()), GetFrontArgs<n>(detail::ConvStringToCharPtr(std::forward<Args>(args))...)));
 	detail::Flush<decltype(f)>(fp);
 }
+//Print(FILE*, ...)と同じ書式でbufの末尾に追記する。
+template <class ...Args>
+void Print(std::string& buf, Args&& ...args)
+{
+	constexpr auto t = detail::GetOptions<std::decay_t<Args>...>();
+	constexpr auto d = std::get<0>(t);
+	constexpr auto e = std::get<1>(t);
+	constexpr size_t n = std::get<3>(t).value;
+	constexpr auto fmt = detail::MakeFormatStr<decltype(d), decltype(e), GetFrontTypesT<n, std::decay_t<Args>...>>::apply();
+	auto append = [&buf, &fmt](auto ...a)
+	{
+		//大抵のコマンドは短いので、まず手元の領域に書き込み、収まらなかった場合のみ長さを測り直す。
+		char tmp[256];
+		int len = snprintf(tmp, sizeof(tmp), fmt.data(), a...);
+		if (len < 0) return;
+		if ((size_t)len < sizeof(tmp))
+		{
+			buf.append(tmp, (size_t)len);
+			return;
+		}
+		size_t old = buf.size();
+		buf.resize(old + (size_t)len + 1);
+		snprintf(&buf[old], (size_t)len + 1, fmt.data(), a...);
+		buf.resize(old + (size_t)len);
+	};
+	Apply(append, GetFrontArgs<n>(detail::ConvStringToCharPtr(std::forward<Args>(args))...));
+}
 template <class ...Args>
 void Print(std::ostream& ost, Args&& ...args)
 {
@@ -0,0 +1,295 @@
+#ifndef CUF_MAPPED_MATRIX_H
+#define CUF_MAPPED_MATRIX_H
+
+#include <array>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <type_traits>
+#include <ADAPT/CUF/MatrixView.h>
+#include <ADAPT/CUF/Exception.h>
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace adapt
+{
+
+inline namespace cuf
+{
+
+namespace detail
+{
+
+//SaveMatrixが書き出すファイルの先頭64バイト。数値はリトルエンディアンで、要素はこの直後からMatrixと同じ順に並ぶ。
+struct MatrixFileHeader
+{
+	char mMagic[8];//"CUFMAT\0\0"
+	uint32_t mVersion;
+	uint32_t mDimension;
+	uint32_t mElementKind;//'f'、'i'、'u'のいずれか。
+	uint32_t mElementSize;
+	uint64_t mSize[4];
+	uint64_t mDataOffset;
+};
+static_assert(sizeof(MatrixFileHeader) == 64, "unexpected padding in MatrixFileHeader");
+
+constexpr char msMatrixFileMagic[8] = { 'C', 'U', 'F', 'M', 'A', 'T', '\0', '\0' };
+
+template <class T>
+constexpr uint32_t GetMatrixFileElementKind()
+{
+	return std::is_floating_point<T>::value ? 'f' : std::is_signed<T>::value ? 'i' : 'u';
+}
+
+}
+
+//バイナリファイルを読み取り専用でメモリに割り当て、Matrixと同じ並びの要素をMatrixViewとして参照する。
+//要素はアクセスされた部分のみがOSによって読み込まれるので、メモリより大きなファイルの一部（2次元断面など）を描画できる。
+//ファイルはSaveMatrixの形式（ヘッダ付き）か、大きさと先頭位置を与えた生の配列とする。エンディアンの変換は行わない。
+template <class T, int Dim = 2>
+class MappedMatrix
+{
+	static_assert(std::is_arithmetic<T>::value, "MappedMatrix supports arithmetic element types only");
+	static_assert(Dim >= 1 && Dim <= 4, "MappedMatrix supports 1 to 4 dimensions");
+
+public:
+
+	MappedMatrix()
+		: mMapping(nullptr), mMappedSize(0)
+	{}
+	//SaveMatrixで書き出したファイルを開く。要素の型や次元がT、Dimと異なればInvalidArgを投げる。
+	explicit MappedMatrix(const std::string& path)
+		: MappedMatrix()
+	{
+		Map(path, 0, 0);
+		detail::MatrixFileHeader h;
+		if (mMappedSize < sizeof(h)) throw InvalidArg("file \"" + path + "\" is not a matrix file.");
+		std::memcpy(&h, mMapping, sizeof(h));
+		if (std::memcmp(h.mMagic, detail::msMatrixFileMagic, sizeof(h.mMagic)) != 0 || h.mVersion != 1)
+			throw InvalidArg("file \"" + path + "\" is not a matrix file.");
+		if (h.mDimension != (uint32_t)Dim || h.mElementKind != detail::GetMatrixFileElementKind<T>() || h.mElementSize != sizeof(T))
+			throw InvalidArg("the element type or the dimension of file \"" + path + "\" does not match.");
+		//各次元の大きさはMatrixViewと同じくuint32_tに収まらなければならない。
+		std::array<uint32_t, Dim> size;
+		for (int i = 0; i < Dim; ++i)
+		{
+			if (h.mSize[i] > std::numeric_limits<uint32_t>::max())
+				throw InvalidArg("the size of file \"" + path + "\" exceeds the range of uint32_t.");
+			size[i] = (uint32_t)h.mSize[i];
+		}
+		if (h.mDataOffset > mMappedSize) throw InvalidArg("file \"" + path + "\" is not a matrix file.");
+		SetView(path, size, (size_t)h.mDataOffset, (const char*)mMapping);
+	}
+	//ヘッダのない生の配列のファイルを開く。要素はoffsetバイト目から始まるとする。
+	MappedMatrix(const std::string& path, const std::array<uint32_t, Dim>& size, size_t offset = 0)
+		: MappedMatrix()
+	{
+		//割り当ての開始位置はページ境界でなければならないので、offsetを含むページから割り当てる。
+		size_t granularity = GetGranularity();
+		size_t begin = offset / granularity * granularity;
+		size_t bytes = GetBytes(path, size);
+		Map(path, begin, offset - begin + bytes);
+		SetView(path, size, offset - begin, (const char*)mMapping);
+	}
+	MappedMatrix(const MappedMatrix&) = delete;
+	MappedMatrix& operator=(const MappedMatrix&) = delete;
+	MappedMatrix(MappedMatrix&& m) noexcept
+		: mMapping(m.mMapping), mMappedSize(m.mMappedSize), mView(m.mView)
+	{
+		m.mMapping = nullptr;
+		m.mMappedSize = 0;
+		m.mView = MatrixView<const T, Dim>();
+	}
+	MappedMatrix& operator=(MappedMatrix&& m) noexcept
+	{
+		Unmap();
+		std::swap(mMapping, m.mMapping);
+		std::swap(mMappedSize, m.mMappedSize);
+		std::swap(mView, m.mView);
+		return *this;
+	}
+	~MappedMatrix()
+	{
+		Unmap();
+	}
+
+	bool IsOpen() const { return mMapping != nullptr; }
+	uint32_t GetSize(int dim) const { return mView.GetSize(dim); }
+	size_t GetCapacity() const { return mView.GetCapacity(); }
+	const T* GetData() const { return mView.GetData(); }
+	const MatrixView<const T, Dim>& GetView() const { return mView; }
+	//PlotColormapなど、MatrixViewを受け取る関数にそのまま渡せる。
+	operator MatrixView<const T, Dim>() const { return mView; }
+
+private:
+
+	static size_t GetGranularity()
+	{
+#if defined(_WIN32)
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		return si.dwAllocationGranularity;
+#else
+		return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+	}
+	//ファイルのoffsetバイト目からsizeバイトを割り当てる。sizeが0ならファイルの終わりまで。
+	void Map(const std::string& path, size_t offset, size_t size)
+	{
+#if defined(_WIN32)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) throw InvalidArg("file \"" + path + "\" cannot open.");
+		LARGE_INTEGER filesize;
+		if (!GetFileSizeEx(file, &filesize))
+		{
+			CloseHandle(file);
+			throw InvalidArg("the size of file \"" + path + "\" cannot be read.");
+		}
+		size_t total = (size_t)filesize.QuadPart;
+#else
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw InvalidArg("file \"" + path + "\" cannot open.");
+		struct stat st;
+		if (fstat(fd, &st) != 0)
+		{
+			close(fd);
+			throw InvalidArg("the size of file \"" + path + "\" cannot be read.");
+		}
+		size_t total = (size_t)st.st_size;
+#endif
+		if (size == 0) size = total > offset ? total - offset : 0;
+		bool ok = size <= total && offset <= total - size && size > 0;
+		void* p = nullptr;
+		if (ok)
+		{
+#if defined(_WIN32)
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mapping != nullptr)
+			{
+				p = MapViewOfFile(mapping, FILE_MAP_READ, (DWORD)((uint64_t)offset >> 32), (DWORD)(offset & 0xffffffff), size);
+				CloseHandle(mapping);
+			}
+#else
+			p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, (off_t)offset);
+			if (p == MAP_FAILED) p = nullptr;
+#endif
+		}
+#if defined(_WIN32)
+		CloseHandle(file);
+#else
+		close(fd);
+#endif
+		if (!ok) throw InvalidArg("file \"" + path + "\" is smaller than the matrix.");
+		if (p == nullptr) throw InvalidArg("file \"" + path + "\" cannot be mapped.");
+		mMapping = p;
+		mMappedSize = size;
+	}
+	//全要素のバイト数。size_tに収まらなければInvalidArgを投げる。
+	static size_t GetBytes(const std::string& path, const std::array<uint32_t, Dim>& size)
+	{
+		size_t bytes = sizeof(T);
+		for (int i = 0; i < Dim; ++i)
+		{
+			if (size[i] != 0 && bytes > std::numeric_limits<size_t>::max() / size[i])
+				throw InvalidArg("the matrix in file \"" + path + "\" is too large to be mapped.");
+			bytes *= size[i];
+		}
+		return bytes;
+	}
+	void SetView(const std::string& path, const std::array<uint32_t, Dim>& size, size_t offset, const char* base)
+	{
+		size_t bytes = GetBytes(path, size);
+		std::array<ptrdiff_t, Dim> stride;
+		size_t step = 1;
+		for (int i = Dim - 1; i >= 0; --i)
+		{
+			stride[i] = (ptrdiff_t)step;
+			step *= size[i];
+		}
+		if (offset > mMappedSize || bytes > mMappedSize - offset) throw InvalidArg("file \"" + path + "\" is smaller than the matrix.");
+		if (offset % alignof(T) != 0) throw InvalidArg("elements in file \"" + path + "\" are not aligned.");
+		mView = MatrixView<const T, Dim>(reinterpret_cast<const T*>(base + offset), size, stride);
+	}
+	void Unmap()
+	{
+		if (mMapping == nullptr) return;
+#if defined(_WIN32)
+		UnmapViewOfFile(mMapping);
+#else
+		munmap(mMapping, mMappedSize);
+#endif
+		mMapping = nullptr;
+		mMappedSize = 0;
+	}
+
+	void* mMapping;
+	size_t mMappedSize;
+	MatrixView<const T, Dim> mView;
+};
+
+//MappedMatrixで開ける形式で書き出す。headerがfalseの場合は要素のみを書き出す。
+template <class T, int Dim>
+void SaveMatrix(const std::string& path, const MatrixView<T, Dim>& v, bool header = true)
+{
+	using Value = std::remove_const_t<T>;
+	static_assert(std::is_arithmetic<Value>::value, "SaveMatrix supports arithmetic element types only");
+	static_assert(Dim >= 1 && Dim <= 4, "SaveMatrix supports 1 to 4 dimensions");
+	std::ofstream ofs(path, std::ios::binary);
+	if (!ofs) throw InvalidArg("file \"" + path + "\" cannot open.");
+	if (header)
+	{
+		detail::MatrixFileHeader h = {};
+		std::memcpy(h.mMagic, detail::msMatrixFileMagic, sizeof(h.mMagic));
+		h.mVersion = 1;
+		h.mDimension = Dim;
+		h.mElementKind = detail::GetMatrixFileElementKind<Value>();
+		h.mElementSize = sizeof(Value);
+		for (int i = 0; i < Dim; ++i) h.mSize[i] = v.GetSize(i);
+		h.mDataOffset = sizeof(h);
+		ofs.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	}
+	if (v.IsContiguous())
+	{
+		ofs.write(reinterpret_cast<const char*>(v.GetData()), (std::streamsize)(v.GetCapacity() * sizeof(Value)));
+	}
+	else
+	{
+		//連続していないビューは、一定の要素数ごとにまとめて書き出す。
+		std::vector<Value> buf;
+		buf.reserve(1 << 16);
+		v.ForEach([&](const Value& x)
+		{
+			buf.push_back(x);
+			if (buf.size() == buf.capacity())
+			{
+				ofs.write(reinterpret_cast<const char*>(buf.data()), (std::streamsize)(buf.size() * sizeof(Value)));
+				buf.clear();
+			}
+		});
+		ofs.write(reinterpret_cast<const char*>(buf.data()), (std::streamsize)(buf.size() * sizeof(Value)));
+	}
+	if (!ofs) throw InvalidArg("file \"" + path + "\" cannot be written.");
+}
+template <class T, int Dim>
+void SaveMatrix(const std::string& path, const Matrix<T, Dim>& m, bool header = true)
+{
+	SaveMatrix(path, MakeView(m), header);
+}
+
+}
+
+}
+
+#endif
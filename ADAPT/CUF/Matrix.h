@@ -3,9 +3,18 @@
 
 #include <memory>
 #include <cassert>
+#include <cstring>
+#include <algorithm>
 #include <numeric>
+#include <functional>
+#include <type_traits>
+#include <array>
+#include <tuple>
 #include <ADAPT/CUF/Template.h>
 #include <ADAPT/CUF/Function.h>
+#include <ADAPT/CUF/Simd.h>
+#include <ADAPT/CUF/MemoryResource.h>
+#include <ADAPT/CUF/Parallel.h>
 
 namespace adapt
 {
@@ -14,9 +23,29 @@ inline namespace cuf
 {
 
 template <class T, int Dim = 2>
+class Matrix;
+
+namespace detail
+{
+
+//要素ごとの演算を遅延評価する式の基底クラス。
+struct MatrixExprBase {};
+template <class E>
+constexpr bool IsMatrixExpr = std::is_base_of<MatrixExprBase, std::decay_t<E>>::value;
+
+}
+
+//要素はGetMemoryResource()から確保され、先頭はmsAlignment（64バイト以上）の境界に揃えられる。
+//確保した領域の直前には各次元の大きさと確保に用いたメモリ資源を置く。
+template <class T, int Dim>
 class Matrix
 {
 	static constexpr size_t msRangeSize = (Dim + Dim % 2) * sizeof(uint32_t);
+	static constexpr size_t msAlignment = alignof(T) > 64 ? alignof(T) : 64;
+	//要素の前には、先頭側から要素数、メモリ資源、各次元の大きさを置く。
+	static constexpr size_t msHeaderSize = (msRangeSize + sizeof(MemoryResource*) + sizeof(size_t) + msAlignment - 1) / msAlignment * msAlignment;
+	//double、float、整数などは、コピーや初期化をmemcpy、memset、std::fill_nでまとめて行う。
+	static constexpr bool msTriviallyCopyable = std::is_trivially_copyable<T>::value;
 	struct Range
 	{
 		const uint32_t& operator[](int dim) const
@@ -186,40 +215,69 @@ public:
 	Matrix(const Matrix& m)
 		: mMatrixData(nullptr)
 	{
+		if (m.mMatrixData == nullptr) return;
 		size_t cap = m.GetCapacity();
 		Allocate(cap);
 		GetRange() = m.GetRange();
-		T* it = mMatrixData;
-		const T* it2 = m.mMatrixData;
-		const T* end = it + cap;
-		for (; it != end; ++it, ++it2) new (it) T(*it2);
+		CopyConstructAll(cap, m.mMatrixData);
 	}
 	Matrix(Matrix&& m) noexcept
 		: mMatrixData(m.mMatrixData)
 	{
 		m.mMatrixData = nullptr;
 	}
+	//要素ごとの演算の式（a * 2. + bなど）を、一時オブジェクトを作らずに1回の走査で評価する。
+	template <class Expr, std::enable_if_t<detail::IsMatrixExpr<Expr>, std::nullptr_t> = nullptr>
+	Matrix(const Expr& e)
+		: mMatrixData(nullptr)
+	{
+		static_assert(Expr::GetDimension() == Dim, "dimension mismatch");
+		size_t cap = e.GetCapacity();
+		Allocate(cap);
+		for (int i = 0; i < Dim; ++i) GetRange()[i] = e.GetSize(i);
+		T* it = mMatrixData;
+		for (size_t i = 0; i < cap; ++i, ++it) new (it) T(e[i]);
+	}
 
 	Matrix<T, Dim>& operator=(const Matrix& m)
 	{
+		if (this == &m) return *this;
+		if (m.mMatrixData == nullptr)
+		{
+			Destroy();
+			return *this;
+		}
 		size_t cap = m.GetCapacity();
 		if (mMatrixData == nullptr) Allocate(cap);
 		else if(GetCapacity() != cap) Reallocate(cap);
 		else DestructAll(cap);
 
-		{
-			GetRange() = m.GetRange();
-			T* it = mMatrixData;
-			const T* it2 = m.mMatrixData;
-			const T* end = it + cap;
-			for (; it != end; ++it, ++it2) new (it) T(*it2);
-		}
+		GetRange() = m.GetRange();
+		CopyConstructAll(cap, m.mMatrixData);
 		return *this;
 	}
 	Matrix<T, Dim>& operator=(Matrix&& m)
 	{
-		mMatrixData = m.mMatrixData;
-		m.mMatrixData = nullptr;
+		//元の領域はmのデストラクタで解放される。
+		std::swap(mMatrixData, m.mMatrixData);
+		return *this;
+	}
+	template <class Expr, std::enable_if_t<detail::IsMatrixExpr<Expr>, std::nullptr_t> = nullptr>
+	Matrix<T, Dim>& operator=(const Expr& e)
+	{
+		static_assert(Expr::GetDimension() == Dim, "dimension mismatch");
+		if (mMatrixData != nullptr && HasSameSize(e))
+		{
+			//各要素は式の同じ位置の要素のみに依存するので、a = a * 2. + bのように自身を含む式でも上書きしてよい。
+			size_t cap = GetCapacity();
+			T* p = mMatrixData;
+			for (size_t i = 0; i < cap; ++i) p[i] = e[i];
+		}
+		else
+		{
+			Matrix res(e);
+			std::swap(mMatrixData, res.mMatrixData);
+		}
 		return *this;
 	}
 	~Matrix()
@@ -271,12 +329,12 @@ public:
 	}
 
 	static constexpr int GetDimension() { return Dim; }
-	uint32_t GetSize(uint32_t dim) const { return GetRange()[dim]; }
+	//空の行列では、GetCapacityと同様に0を返す。
+	uint32_t GetSize(uint32_t dim) const { return mMatrixData != nullptr ? GetRange()[dim] : 0; }
+	//要素数は確保の際に記録したものを返す。
 	size_t GetCapacity() const
 	{
-		size_t res = 1;
-		for (int i = 0; i < Dim; ++i) res *= GetSize(i);
-		return res;
+		return mMatrixData != nullptr ? GetStoredCapacity() : 0;
 	}
 	//std::array<uint32_t, Dim> GetSizes() const { return mSize; }
 
@@ -369,43 +427,102 @@ public:
 	T* begin() { return mMatrixData; }
 	const T* begin() const { return mMatrixData; }
 	const T* cbegin() const { return begin(); }
-	T* end() { return mMatrixData + std::accumulate(GetRange().begin(), GetRange().end(), 1, std::multiplies<uint32_t>()); }
-	const T* end() const { return mMatrixData + std::accumulate(GetRange().begin(), GetRange().end(), 1, std::multiplies<uint32_t>()); }
+	T* end() { return mMatrixData + GetCapacity(); }
+	const T* end() const { return mMatrixData + GetCapacity(); }
 	const T* cend() const { return end(); }
 
-	Matrix& operator*=(const T& x) { for (auto& e : *this) e *= x; return *this; }
-	Matrix& operator/=(const T& x) { for (auto& e : *this) e /= x; return *this; }
+	//全要素にxを代入する。
+	Matrix& Fill(const T& x)
+	{
+		if constexpr (msTriviallyCopyable) FillTrivial(mMatrixData, GetCapacity(), x);
+		else std::fill_n(mMatrixData, GetCapacity(), x);
+		return *this;
+	}
 
-	friend Matrix operator*(const Matrix& m, const T& t) { Matrix res = m; res *= t; return std::move(res); }
-	friend Matrix operator*(const T& t, const Matrix& m) { Matrix res = m; res *= t; return std::move(res); }
-	friend Matrix operator/(const Matrix& m, const T& t) { Matrix res = m; res /= t; return std::move(res); }
-	friend Matrix operator/(const T& t, const Matrix& m) { Matrix res = m; res /= t; return std::move(res); }
+	//double、floatはSimd.hのベクトル化された処理を用いる。
+	Matrix& operator*=(const T& x)
+	{
+		if constexpr (detail::IsSimdType<T>) SimdMultiply(mMatrixData, GetCapacity(), x);
+		else for (auto& e : *this) e *= x;
+		return *this;
+	}
+	Matrix& operator/=(const T& x)
+	{
+		if constexpr (detail::IsSimdType<T>) SimdDivide(mMatrixData, GetCapacity(), x);
+		else for (auto& e : *this) e /= x;
+		return *this;
+	}
 
+	//+、-、スカラーとの*、/は式オブジェクトを返す（operator+などは下で定義する）。
+	//2次元の行列同士の*は行列積なので、要素ごとの積はHadamard(a, b)を用いる。
 	Matrix& operator+=(const Matrix& x)
 	{
 		assert(GetRange() == x.GetRange());
-		for (const auto& t : BundleRange(*this, x))
-			std::get<0>(t) += std::get<1>(t);
+		if constexpr (detail::IsSimdType<T>) SimdAdd(mMatrixData, x.mMatrixData, GetCapacity());
+		else
+		{
+			for (const auto& t : BundleRange(*this, x))
+				std::get<0>(t) += std::get<1>(t);
+		}
 		return *this;
 	}
-	friend Matrix operator+(const Matrix& a, const Matrix& b)
-	{
-		Matrix res(a);
-		res += b;
-		return std::move(res);
-	}
 	Matrix& operator-=(const Matrix& x)
 	{
 		assert(GetRange() == x.GetRange());
-		for (const auto& t : BundleRange(*this, x))
-			std::get<0>(t) -= std::get<1>(t);
+		if constexpr (detail::IsSimdType<T>) SimdSubtract(mMatrixData, x.mMatrixData, GetCapacity());
+		else
+		{
+			for (const auto& t : BundleRange(*this, x))
+				std::get<0>(t) -= std::get<1>(t);
+		}
 		return *this;
 	}
-	friend Matrix operator-(const Matrix& a, const Matrix& b)
+	template <class Expr, std::enable_if_t<detail::IsMatrixExpr<Expr>, std::nullptr_t> = nullptr>
+	Matrix& operator+=(const Expr& e)
 	{
-		Matrix res(a);
-		res -= b;
-		return std::move(res);
+		assert(HasSameSize(e));
+		size_t cap = GetCapacity();
+		for (size_t i = 0; i < cap; ++i) mMatrixData[i] += e[i];
+		return *this;
+	}
+	template <class Expr, std::enable_if_t<detail::IsMatrixExpr<Expr>, std::nullptr_t> = nullptr>
+	Matrix& operator-=(const Expr& e)
+	{
+		assert(HasSameSize(e));
+		size_t cap = GetCapacity();
+		for (size_t i = 0; i < cap; ++i) mMatrixData[i] -= e[i];
+		return *this;
+	}
+	//式と同じ大きさかどうか。
+	template <class Expr>
+	bool HasSameSize(const Expr& e) const
+	{
+		for (int i = 0; i < Dim; ++i) if (GetSize(i) != e.GetSize(i)) return false;
+		return true;
+	}
+
+	//全要素について、Matrixと同じ順にf(i0, i1, ...)を呼び、戻り値を代入する。
+	//fはインデックスを個別の引数として受け取るか、std::array<uint32_t, Dim>として受け取る。
+	template <class Func>
+	Matrix& Generate(Func f)
+	{
+		if (GetCapacity() == 0) return *this;
+		Generate_impl(f, 0, GetSize(0));
+		return *this;
+	}
+	//Generateの並列版。最初の次元をParallelForで分割し、各スレッドが担当する範囲の要素に直接書き込む。
+	//fは複数のスレッドから同時に呼ばれる。grainはスレッドに割り振る最小の要素数。
+	template <class Func>
+	Matrix& ParallelGenerate(Func f, size_t grain = 4096)
+	{
+		size_t cap = GetCapacity();
+		if (cap == 0) return *this;
+		size_t rowsize = cap / GetSize(0);
+		ParallelFor(0, GetSize(0), [this, &f](size_t b, size_t e, size_t)
+		{
+			Generate_impl(f, (uint32_t)b, (uint32_t)e);
+		}, std::max<size_t>(1, grain / rowsize));
+		return *this;
 	}
 
 	//配列の再確保のための関数。
@@ -452,8 +569,11 @@ protected:
 	void Allocate(size_t size)
 	{
 		assert(mMatrixData == nullptr);
-		char* p = (char*)malloc(size * sizeof(T) + msRangeSize);
-		mMatrixData = (T*)(p + msRangeSize);
+		MemoryResource* r = GetMemoryResource();
+		char* p = (char*)r->Allocate(size * sizeof(T) + msHeaderSize, msAlignment);
+		mMatrixData = (T*)(p + msHeaderSize);
+		GetResource() = r;
+		GetStoredCapacity() = size;
 	}
 	void Reallocate(size_t size)
 	{
@@ -463,20 +583,85 @@ protected:
 	void Destroy()
 	{
 		if (mMatrixData == nullptr) return;
-		DestructAll(GetCapacity());
+		size_t cap = GetCapacity();
+		DestructAll(cap);
 		char* ptr = (char*)mMatrixData;
-		free(ptr - msRangeSize);
+		GetResource()->Deallocate(ptr - msHeaderSize, cap * sizeof(T) + msHeaderSize, msAlignment);
 		mMatrixData = nullptr;
 	}
 	void ConstructAll(size_t cap, const T& t)
 	{
-		T* it = mMatrixData;
-		T* end = mMatrixData + cap;
-		for (; it != end; ++it) new (it) T(t);
+		if constexpr (msTriviallyCopyable) FillTrivial(mMatrixData, cap, t);
+		else
+		{
+			T* it = mMatrixData;
+			T* end = mMatrixData + cap;
+			for (; it != end; ++it) new (it) T(t);
+		}
+	}
+	void CopyConstructAll(size_t cap, const T* src)
+	{
+		if constexpr (msTriviallyCopyable)
+		{
+			if (cap != 0) std::memcpy((void*)mMatrixData, (const void*)src, cap * sizeof(T));
+		}
+		else
+		{
+			T* it = mMatrixData;
+			T* end = mMatrixData + cap;
+			for (; it != end; ++it, ++src) new (it) T(*src);
+		}
+	}
+	//全てのバイトが0の値（0、0.0、nullptrなど）はmemsetで、それ以外はstd::fill_nで埋める。
+	static void FillTrivial(T* p, size_t cap, const T& t)
+	{
+		const unsigned char* b = reinterpret_cast<const unsigned char*>(&t);
+		if (std::all_of(b, b + sizeof(T), [](unsigned char c) { return c == 0; }))
+		{
+			if (cap != 0) std::memset((void*)p, 0, cap * sizeof(T));
+		}
+		else std::fill_n(p, cap, t);
+	}
+	template <class Func, size_t ...Indices>
+	static constexpr bool IsIndexGenerator(std::index_sequence<Indices...>)
+	{
+		return std::is_invocable<Func&, decltype((void)Indices, uint32_t())...>::value;
+	}
+	//最初の次元が[begin, end)の要素をf(i0, i1, ...)で埋める。
+	template <class Func>
+	void Generate_impl(Func& f, uint32_t begin, uint32_t end)
+	{
+		auto call = [&f](const std::array<uint32_t, Dim>& index) -> T
+		{
+			if constexpr (IsIndexGenerator<Func>(std::make_index_sequence<Dim>())) return std::apply(f, index);
+			else return f(index);
+		};
+		const Range& range = GetRange();
+		std::array<uint32_t, Dim> index = {};
+		if constexpr (Dim == 1)
+		{
+			for (index[0] = begin; index[0] < end; ++index[0]) mMatrixData[index[0]] = call(index);
+		}
+		else
+		{
+			index[0] = begin;
+			T* p = mMatrixData + (size_t)begin * (GetCapacity() / range[0]);
+			while (index[0] < end)
+			{
+				for (index[Dim - 1] = 0; index[Dim - 1] < range[Dim - 1]; ++index[Dim - 1], ++p) *p = call(index);
+				//最後の次元以外を繰り上げる。
+				for (int d = Dim - 2; d >= 0; --d)
+				{
+					if (++index[d] < range[d] || d == 0) break;
+					index[d] = 0;
+				}
+			}
+		}
 	}
 	void DestructAll(size_t cap)
 	{
 		//メモリ解放を行わない、ただ要素を全削除するもの。
+		if constexpr (std::is_trivially_destructible<T>::value) return;
 		T* it = mMatrixData;
 		T* end = mMatrixData + cap;
 		for (; it != end; ++it) it->~T();
@@ -484,6 +669,9 @@ protected:
 
 	Range& GetRange() { return *reinterpret_cast<Range*>((char*)mMatrixData - msRangeSize); }
 	const Range& GetRange() const { return *reinterpret_cast<const Range*>((char*)mMatrixData - msRangeSize); }
+	MemoryResource*& GetResource() { return *reinterpret_cast<MemoryResource**>((char*)mMatrixData - msRangeSize - sizeof(MemoryResource*)); }
+	size_t& GetStoredCapacity() { return *reinterpret_cast<size_t*>((char*)mMatrixData - msRangeSize - sizeof(MemoryResource*) - sizeof(size_t)); }
+	const size_t& GetStoredCapacity() const { return *reinterpret_cast<const size_t*>((char*)mMatrixData - msRangeSize - sizeof(MemoryResource*) - sizeof(size_t)); }
 
 	//std::array<uint32_t, Dim> mSize;
 	T* mMatrixData;
@@ -492,12 +680,181 @@ protected:
 template <class T>
 using Vector = Matrix<T, 1>;
 
+namespace detail
+{
+
+template <class M>
+struct IsMatrixType : std::false_type {};
+template <class T, int Dim>
+struct IsMatrixType<Matrix<T, Dim>> : std::true_type {};
+template <class E>
+constexpr bool IsMatrixOperand = IsMatrixType<std::decay_t<E>>::value || IsMatrixExpr<E>;
+
+//式の中では、Matrixは参照で、式やスカラーは値で保持する。
+template <class E>
+struct MatrixOperand { using Type = E; };
+template <class T, int Dim>
+struct MatrixOperand<Matrix<T, Dim>> { using Type = const Matrix<T, Dim>&; };
+
+template <class S>
+struct ScalarOperand
+{
+	S operator[](size_t) const { return mValue; }
+	S mValue;
+};
+template <class E>
+struct IsScalarOperand : std::false_type {};
+template <class S>
+struct IsScalarOperand<ScalarOperand<S>> : std::true_type {};
+
+template <class T, int Dim>
+const T& GetMatrixElement(const Matrix<T, Dim>& m, size_t i) { return m.begin()[i]; }
+template <class E>
+decltype(auto) GetMatrixElement(const E& e, size_t i) { return e[i]; }
+
+template <class Op, class L, class R>
+class MatrixBinaryExpr : public MatrixExprBase
+{
+	//大きさは行列の側から得る。
+	static constexpr bool msLeftIsMatrix = !IsScalarOperand<L>::value;
+public:
+
+	MatrixBinaryExpr(const L& l, const R& r)
+		: mLeft(l), mRight(r)
+	{
+		if constexpr (!IsScalarOperand<L>::value && !IsScalarOperand<R>::value)
+		{
+			for (int i = 0; i < GetDimension(); ++i) assert(mLeft.GetSize(i) == mRight.GetSize(i));
+		}
+	}
+
+	static constexpr int GetDimension()
+	{
+		if constexpr (msLeftIsMatrix) return std::decay_t<L>::GetDimension();
+		else return std::decay_t<R>::GetDimension();
+	}
+	uint32_t GetSize(uint32_t dim) const
+	{
+		if constexpr (msLeftIsMatrix) return mLeft.GetSize(dim);
+		else return mRight.GetSize(dim);
+	}
+	size_t GetCapacity() const
+	{
+		if constexpr (msLeftIsMatrix) return mLeft.GetCapacity();
+		else return mRight.GetCapacity();
+	}
+	//行列を1次元に並べたときのi番目の要素。
+	auto operator[](size_t i) const
+	{
+		return Op()(GetMatrixElement(mLeft, i), GetMatrixElement(mRight, i));
+	}
+
+private:
+
+	typename MatrixOperand<L>::Type mLeft;
+	typename MatrixOperand<R>::Type mRight;
+};
+
+template <class Op, class E>
+class MatrixUnaryExpr : public MatrixExprBase
+{
+public:
+
+	explicit MatrixUnaryExpr(const E& e) : mExpr(e) {}
+
+	static constexpr int GetDimension() { return std::decay_t<E>::GetDimension(); }
+	uint32_t GetSize(uint32_t dim) const { return mExpr.GetSize(dim); }
+	size_t GetCapacity() const { return mExpr.GetCapacity(); }
+	auto operator[](size_t i) const { return Op()(GetMatrixElement(mExpr, i)); }
+
+private:
+
+	typename MatrixOperand<E>::Type mExpr;
+};
+
+//スカラーは従来のoperator*(const Matrix&, const T&)と同様に、行列の要素の型へ変換してから演算する。
+template <class M>
+using MatrixElementT = std::decay_t<decltype(GetMatrixElement(std::declval<const M&>(), 0))>;
+template <class M>
+using ScalarOperandFor = ScalarOperand<MatrixElementT<M>>;
+
+template <class L, class R>
+using EnableIfMatrixOperands = std::enable_if_t<IsMatrixOperand<L> && IsMatrixOperand<R>, std::nullptr_t>;
+//Sが行列ではなく、Mの要素の型へ変換できる場合にスカラーとして扱う（std::complexなど算術型以外の要素も含む）。
+template <class M, class S, class = void>
+struct IsScalarFor : std::false_type {};
+template <class M, class S>
+struct IsScalarFor<M, S, std::enable_if_t<IsMatrixOperand<M> && !IsMatrixOperand<S>>>
+	: std::is_convertible<const S&, MatrixElementT<M>> {};
+template <class M, class S>
+using EnableIfMatrixAndScalar = std::enable_if_t<IsScalarFor<M, S>::value, std::nullptr_t>;
+
+}
+
+//Matrixまたは式同士、およびスカラーとの要素ごとの演算。結果は式オブジェクトで、Matrixへの代入時に評価される。
+//スカラーは行列の要素の型に変換してから演算する（Matrix<int>に2.5を掛けると2倍になる）。
+//s / mは各要素についてs / m[i]を計算する。
+//式はオペランドのMatrixを参照で保持するので、autoで受けて元のMatrixより長く保持してはならない。
+template <class L, class R, detail::EnableIfMatrixOperands<L, R> = nullptr>
+detail::MatrixBinaryExpr<std::plus<>, L, R> operator+(const L& l, const R& r) { return { l, r }; }
+template <class L, class R, detail::EnableIfMatrixOperands<L, R> = nullptr>
+detail::MatrixBinaryExpr<std::minus<>, L, R> operator-(const L& l, const R& r) { return { l, r }; }
+template <class L, class R, detail::EnableIfMatrixOperands<L, R> = nullptr>
+detail::MatrixBinaryExpr<std::divides<>, L, R> operator/(const L& l, const R& r) { return { l, r }; }
+//要素ごとの積。
+template <class L, class R, detail::EnableIfMatrixOperands<L, R> = nullptr>
+detail::MatrixBinaryExpr<std::multiplies<>, L, R> Hadamard(const L& l, const R& r) { return { l, r }; }
+
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::plus<>, M, detail::ScalarOperandFor<M>> operator+(const M& m, S s) { return { m, { (detail::MatrixElementT<M>)s } }; }
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::plus<>, detail::ScalarOperandFor<M>, M> operator+(S s, const M& m) { return { { (detail::MatrixElementT<M>)s }, m }; }
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::minus<>, M, detail::ScalarOperandFor<M>> operator-(const M& m, S s) { return { m, { (detail::MatrixElementT<M>)s } }; }
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::minus<>, detail::ScalarOperandFor<M>, M> operator-(S s, const M& m) { return { { (detail::MatrixElementT<M>)s }, m }; }
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::multiplies<>, M, detail::ScalarOperandFor<M>> operator*(const M& m, S s) { return { m, { (detail::MatrixElementT<M>)s } }; }
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::multiplies<>, detail::ScalarOperandFor<M>, M> operator*(S s, const M& m) { return { { (detail::MatrixElementT<M>)s }, m }; }
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::divides<>, M, detail::ScalarOperandFor<M>> operator/(const M& m, S s) { return { m, { (detail::MatrixElementT<M>)s } }; }
+template <class M, class S, detail::EnableIfMatrixAndScalar<M, S> = nullptr>
+detail::MatrixBinaryExpr<std::divides<>, detail::ScalarOperandFor<M>, M> operator/(S s, const M& m) { return { { (detail::MatrixElementT<M>)s }, m }; }
+
+template <class M, std::enable_if_t<detail::IsMatrixOperand<M>, std::nullptr_t> = nullptr>
+detail::MatrixUnaryExpr<std::negate<>, M> operator-(const M& m) { return detail::MatrixUnaryExpr<std::negate<>, M>(m); }
+
+//式を評価してMatrixを作る。autoで受ける場合などに用いる。
+template <class Expr, std::enable_if_t<detail::IsMatrixExpr<Expr>, std::nullptr_t> = nullptr>
+auto Evaluate(const Expr& e)
+{
+	using T = std::decay_t<decltype(e[0])>;
+	return Matrix<T, Expr::GetDimension()>(e);
+}
+
+//全要素の集計。double、floatはベクトル化される。
+//Min、Max、MinMaxはNaNを無視し、NaN以外の要素がなければNaNを返す。Sum、MeanはNaNやinfをそのまま含む。
+template <class T, int Dim>
+std::pair<T, T> MinMax(const Matrix<T, Dim>& m) { return SimdMinMax(m.begin(), m.GetCapacity()); }
+template <class T, int Dim>
+T Min(const Matrix<T, Dim>& m) { return MinMax(m).first; }
+template <class T, int Dim>
+T Max(const Matrix<T, Dim>& m) { return MinMax(m).second; }
+template <class T, int Dim>
+double Sum(const Matrix<T, Dim>& m) { return SimdSum(m.begin(), m.GetCapacity()); }
+template <class T, int Dim>
+double Mean(const Matrix<T, Dim>& m) { return Sum(m) / m.GetCapacity(); }
+//NaNと±infの要素数。
+template <class T, int Dim>
+size_t CountNonFinite(const Matrix<T, Dim>& m) { return SimdCountNonFinite(m.begin(), m.GetCapacity()); }
+
 template <class T>
 Matrix<T, 2> MakeMatrix(const Vector<T>& r1, const Vector<T>& r2)
 {
 	Matrix<T, 2> res;
 	MakeMatrix(res, r1, r2);
-	return std::move(res);
+	return res;
 }
 template <class T>
 void MakeMatrix(Matrix<T, 2>& res, const Vector<T>& r1, const Vector<T>& r2)
@@ -513,7 +870,7 @@ Matrix<T, 2> MakeMatrix(const Vector<T>& r1, const Vector<T>& r2, const Vector<T
 {
 	Matrix<T, 2> res;
 	MakeMatrix(res, r1, r2, r3);
-	return std::move(res);
+	return res;
 }
 template <class T>
 void MakeMatrix(Matrix<T, 2>& res, const Vector<T>& r1, const Vector<T>& r2, const Vector<T>& r3)
@@ -532,7 +889,7 @@ Matrix<T, 2> operator*(const Matrix<T, 2>& x, const Matrix<T, 2>& y)
 {
 	Matrix<T, 2> res;
 	Multiply(res, x, y);
-	return std::move(res);
+	return res;
 }
 template <class T>
 void Multiply(Matrix<T, 2>& res, const Matrix<T, 2>& x, const Matrix<T, 2>& y)
@@ -560,7 +917,7 @@ Vector<T> operator*(const Matrix<T, 2>& x, const Vector<T>& y)
 {
 	Vector<T> res;
 	Multiply(res, x, y);
-	return std::move(res);
+	return res;
 }
 template <class T>
 void Multiply(Vector<T>& res, const Matrix<T, 2>& x, const Vector<T>& y)
@@ -580,12 +937,30 @@ void Multiply(Vector<T>& res, const Matrix<T, 2>& x, const Vector<T>& y)
 	}
 }
 
+namespace detail
+{
+
+template <class T, int Dim>
+const Matrix<T, Dim>& EvaluateOperand(const Matrix<T, Dim>& m) { return m; }
+template <class E, std::enable_if_t<IsMatrixExpr<E>, std::nullptr_t> = nullptr>
+auto EvaluateOperand(const E& e) { return Evaluate(e); }
+
+}
+
+//式を含む行列積。式を一旦Matrixに評価してから、上の行列同士、行列とベクトルの積を計算する。
+template <class L, class R, std::enable_if_t<(detail::IsMatrixExpr<L> || detail::IsMatrixExpr<R>) &&
+											 detail::IsMatrixOperand<L> && detail::IsMatrixOperand<R>, std::nullptr_t> = nullptr>
+auto operator*(const L& x, const R& y)
+{
+	return detail::EvaluateOperand(x) * detail::EvaluateOperand(y);
+}
+
 template <class T>
 Matrix<T, 2> Transpose(const Matrix<T, 2>& x)
 {
 	Matrix<T, 2> res;
 	Transpose(res, x);
-	return std::move(res);
+	return res;
 }
 template <class T>
 void Transpose(Matrix<T, 2>& res, const Matrix<T, 2>& x)
@@ -608,7 +983,7 @@ T Dot(const Vector<T>& x, const Vector<T>& y)
 	assert(x.GetSize(0) == y.GetSize(0));
 	T res = 0;
 	for (auto t : BundleRange(x, y)) res += std::get<0>(t) * std::get<1>(t);
-	return std::move(res);
+	return res;
 }
 //外積
 template <class T>
@@ -617,7 +992,7 @@ Vector<T> Cross(const Vector<T>& a, const Vector<T>& b)
 	assert(a.GetSize(0) == 3 && b.GetSize(0) == 3);
 	Vector<T> res;
 	Cross(res, a, b);
-	return std::move(res);
+	return res;
 }
 template <class T>
 void Cross(Vector<T>& res, const Vector<T>& a, const Vector<T>& b)
@@ -0,0 +1,260 @@
+#ifndef CUF_MATRIX_VIEW_H
+#define CUF_MATRIX_VIEW_H
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <ADAPT/CUF/Matrix.h>
+
+namespace adapt
+{
+
+inline namespace cuf
+{
+
+//Matrixや配列の一部を、コピーせずに参照する。
+//要素(i0, i1, ...)はGetData()[i0 * GetStride(0) + i1 * GetStride(1) + ...]にある。
+//ストライドは負でもよいが、参照先の範囲内を指していなければならない。
+//ビューは参照先の所有権を持たないので、元のMatrixより長く使ってはならない。元のMatrixの大きさを変えた場合も無効になる。
+//Tをconst doubleなどにすると読み取り専用のビューになる。
+template <class T, int Dim = 2>
+class MatrixView
+{
+	template <class, int>
+	friend class MatrixView;
+
+	using Value = std::remove_const_t<T>;
+
+public:
+
+	//1次元のビューの走査に用いる。
+	class Iterator
+	{
+	public:
+		using iterator_category = std::random_access_iterator_tag;
+		using value_type = Value;
+		using difference_type = ptrdiff_t;
+		using pointer = T*;
+		using reference = T&;
+
+		Iterator() : mPtr(nullptr), mStride(1) {}
+		Iterator(T* p, ptrdiff_t stride) : mPtr(p), mStride(stride) {}
+
+		T& operator*() const { return *mPtr; }
+		T* operator->() const { return mPtr; }
+		T& operator[](ptrdiff_t n) const { return mPtr[n * mStride]; }
+		Iterator& operator++() { mPtr += mStride; return *this; }
+		Iterator operator++(int) { Iterator r = *this; mPtr += mStride; return r; }
+		Iterator& operator--() { mPtr -= mStride; return *this; }
+		Iterator operator--(int) { Iterator r = *this; mPtr -= mStride; return r; }
+		Iterator& operator+=(ptrdiff_t n) { mPtr += n * mStride; return *this; }
+		Iterator& operator-=(ptrdiff_t n) { mPtr -= n * mStride; return *this; }
+		Iterator operator+(ptrdiff_t n) const { return Iterator(mPtr + n * mStride, mStride); }
+		Iterator operator-(ptrdiff_t n) const { return Iterator(mPtr - n * mStride, mStride); }
+		ptrdiff_t operator-(const Iterator& it) const { return (mPtr - it.mPtr) / mStride; }
+		bool operator==(const Iterator& it) const { return mPtr == it.mPtr; }
+		bool operator!=(const Iterator& it) const { return mPtr != it.mPtr; }
+		bool operator<(const Iterator& it) const { return (it.mPtr - mPtr) * mStride > 0; }
+		bool operator>(const Iterator& it) const { return it < *this; }
+		bool operator<=(const Iterator& it) const { return !(it < *this); }
+		bool operator>=(const Iterator& it) const { return !(*this < it); }
+
+	private:
+		T* mPtr;
+		ptrdiff_t mStride;
+	};
+
+	MatrixView()
+		: mData(nullptr), mSize{}, mStride{}
+	{}
+	MatrixView(T* data, const std::array<uint32_t, Dim>& size, const std::array<ptrdiff_t, Dim>& stride)
+		: mData(data), mSize(size), mStride(stride)
+	{}
+	//Matrix全体を参照する。
+	template <class M, std::enable_if_t<std::is_same<std::remove_const_t<M>, Matrix<Value, Dim>>::value &&
+										(std::is_const<T>::value || !std::is_const<M>::value), std::nullptr_t> = nullptr>
+	MatrixView(M& m)
+		: mData(m.begin())
+	{
+		ptrdiff_t stride = 1;
+		for (int i = Dim - 1; i >= 0; --i)
+		{
+			mSize[i] = m.GetSize(i);
+			mStride[i] = stride;
+			stride *= mSize[i];
+		}
+	}
+	//std::vector全体を参照する1次元のビュー。
+	template <class V, bool B = (Dim == 1), std::enable_if_t<B && std::is_same<std::remove_const_t<V>, std::vector<Value>>::value &&
+															 (std::is_const<T>::value || !std::is_const<V>::value), std::nullptr_t> = nullptr>
+	MatrixView(V& v)
+		: mData(v.data()), mSize{ (uint32_t)v.size() }, mStride{ 1 }
+	{}
+	//書き込み可能なビューから読み取り専用のビューへの変換。
+	template <class U, std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value, std::nullptr_t> = nullptr>
+	MatrixView(const MatrixView<U, Dim>& v)
+		: mData(v.mData), mSize(v.mSize), mStride(v.mStride)
+	{}
+
+	static constexpr int GetDimension() { return Dim; }
+	uint32_t GetSize(int dim) const { return mSize[dim]; }
+	ptrdiff_t GetStride(int dim) const { return mStride[dim]; }
+	size_t GetCapacity() const
+	{
+		size_t res = 1;
+		for (int i = 0; i < Dim; ++i) res *= mSize[i];
+		return res;
+	}
+	T* GetData() const { return mData; }
+	bool IsEmpty() const { return GetCapacity() == 0; }
+	//要素がMatrixと同じ順で隙間なく並んでいるかどうか。
+	bool IsContiguous() const
+	{
+		ptrdiff_t stride = 1;
+		for (int i = Dim - 1; i >= 0; --i)
+		{
+			if (mSize[i] != 1 && mStride[i] != stride) return false;
+			stride *= mSize[i];
+		}
+		return true;
+	}
+
+	template <class ...Indices, std::enable_if_t<sizeof...(Indices) == Dim, std::nullptr_t> = nullptr>
+	T& operator()(Indices ...i) const
+	{
+		std::array<uint32_t, Dim> index = { (uint32_t)i... };
+		ptrdiff_t offset = 0;
+		for (int d = 0; d < Dim; ++d)
+		{
+			assert(index[d] < mSize[d]);
+			offset += index[d] * mStride[d];
+		}
+		return mData[offset];
+	}
+	//Matrixと同様に、v[i][j]のように参照できる。Dim>1のときは最初の次元をiに固定したビューを返す。
+	template <bool B = (Dim > 1)>
+	std::enable_if_t<B, MatrixView<T, Dim - 1>> operator[](uint32_t i) const { return Fix(0, i); }
+	template <bool B = (Dim == 1)>
+	std::enable_if_t<B, T&> operator[](uint32_t i) const
+	{
+		assert(i < mSize[0]);
+		return mData[i * mStride[0]];
+	}
+
+	//次元dimの[begin, end)の範囲をstepおきに取り出す。
+	MatrixView Slice(int dim, uint32_t begin, uint32_t end, uint32_t step = 1) const
+	{
+		assert(begin <= end && end <= mSize[dim] && step > 0);
+		MatrixView res = *this;
+		res.mData = mData + begin * mStride[dim];
+		res.mSize[dim] = (end - begin + step - 1) / step;
+		res.mStride[dim] = mStride[dim] * step;
+		return res;
+	}
+	//次元dimの順を逆にする。
+	MatrixView Reverse(int dim) const
+	{
+		MatrixView res = *this;
+		if (mSize[dim] == 0) return res;
+		res.mData = mData + (mSize[dim] - 1) * mStride[dim];
+		res.mStride[dim] = -mStride[dim];
+		return res;
+	}
+	//次元の順を逆にする。2次元の場合は転置。
+	MatrixView Transpose() const
+	{
+		MatrixView res = *this;
+		for (int i = 0; i < Dim; ++i)
+		{
+			res.mSize[i] = mSize[Dim - 1 - i];
+			res.mStride[i] = mStride[Dim - 1 - i];
+		}
+		return res;
+	}
+	//次元dimをindexに固定した、1次元低いビュー。
+	template <bool B = (Dim > 1)>
+	std::enable_if_t<B, MatrixView<T, Dim - 1>> Fix(int dim, uint32_t index) const
+	{
+		assert(index < mSize[dim]);
+		MatrixView<T, Dim - 1> res;
+		res.mData = mData + index * mStride[dim];
+		for (int i = 0, j = 0; i < Dim; ++i)
+		{
+			if (i == dim) continue;
+			res.mSize[j] = mSize[i];
+			res.mStride[j] = mStride[i];
+			++j;
+		}
+		return res;
+	}
+	//2次元のビューのi番目の行（v[i][*]）とj番目の列（v[*][j]）。
+	template <bool B = (Dim == 2)>
+	std::enable_if_t<B, MatrixView<T, 1>> Row(uint32_t i) const { return Fix(0, i); }
+	template <bool B = (Dim == 2)>
+	std::enable_if_t<B, MatrixView<T, 1>> Column(uint32_t j) const { return Fix(1, j); }
+
+	template <bool B = (Dim == 1)>
+	std::enable_if_t<B, Iterator> begin() const { return Iterator(mData, mStride[0]); }
+	template <bool B = (Dim == 1)>
+	std::enable_if_t<B, Iterator> end() const { return Iterator(mData + (ptrdiff_t)mSize[0] * mStride[0], mStride[0]); }
+	template <bool B = (Dim == 1)>
+	std::enable_if_t<B, size_t> size() const { return mSize[0]; }
+
+	//全要素について、Matrixと同じ順（最後の次元が最も速く変わる）にf(element)を呼ぶ。
+	template <class Func>
+	void ForEach(Func f) const
+	{
+		if (GetCapacity() == 0) return;
+		ForEach_impl<0>(mData, f);
+	}
+
+private:
+
+	template <int N, class Func>
+	void ForEach_impl(T* p, Func& f) const
+	{
+		if constexpr (N == Dim - 1)
+		{
+			for (uint32_t i = 0; i < mSize[N]; ++i, p += mStride[N]) f(*p);
+		}
+		else
+		{
+			for (uint32_t i = 0; i < mSize[N]; ++i, p += mStride[N]) ForEach_impl<N + 1>(p, f);
+		}
+	}
+
+	T* mData;
+	std::array<uint32_t, Dim> mSize;
+	std::array<ptrdiff_t, Dim> mStride;
+};
+
+template <class T, int Dim>
+MatrixView<T, Dim> MakeView(Matrix<T, Dim>& m) { return MatrixView<T, Dim>(m); }
+template <class T, int Dim>
+MatrixView<const T, Dim> MakeView(const Matrix<T, Dim>& m) { return MatrixView<const T, Dim>(m); }
+template <class T>
+MatrixView<T, 1> MakeView(std::vector<T>& v) { return MatrixView<T, 1>(v); }
+template <class T>
+MatrixView<const T, 1> MakeView(const std::vector<T>& v) { return MatrixView<const T, 1>(v); }
+
+//ビューの参照する要素をコピーしてMatrixを作る。
+template <class T, int Dim>
+Matrix<std::remove_const_t<T>, Dim> Evaluate(const MatrixView<T, Dim>& v)
+{
+	Matrix<std::remove_const_t<T>, Dim> res;
+	if constexpr (Dim == 1) res.Resize(v.GetSize(0));
+	else if constexpr (Dim == 2) res.Resize(v.GetSize(0), v.GetSize(1));
+	else if constexpr (Dim == 3) res.Resize(v.GetSize(0), v.GetSize(1), v.GetSize(2));
+	else res.Resize(v.GetSize(0), v.GetSize(1), v.GetSize(2), v.GetSize(3));
+	auto* it = res.begin();
+	v.ForEach([&it](const auto& x) { *it++ = x; });
+	return res;
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,301 @@
+#ifndef CUF_MEMORY_RESOURCE_H
+#define CUF_MEMORY_RESOURCE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace adapt
+{
+
+inline namespace cuf
+{
+
+//Matrixなどの記憶領域の確保に用いるメモリ資源。
+//Deallocateには確保時と同じbytesとalignmentが渡される。
+class MemoryResource
+{
+public:
+	virtual ~MemoryResource() = default;
+	virtual void* Allocate(size_t bytes, size_t alignment) = 0;
+	virtual void Deallocate(void* p, size_t bytes, size_t alignment) = 0;
+};
+
+//alignmentバイト境界に揃えて確保する。既定のメモリ資源。
+class AlignedResource : public MemoryResource
+{
+public:
+	void* Allocate(size_t bytes, size_t alignment) override
+	{
+		alignment = std::max(alignment, alignof(std::max_align_t));
+#if defined(_MSC_VER)
+		void* p = _aligned_malloc(std::max<size_t>(bytes, 1), alignment);
+#else
+		//aligned_allocはsizeがalignmentの倍数であることを要求する。
+		void* p = std::aligned_alloc(alignment, (std::max<size_t>(bytes, 1) + alignment - 1) / alignment * alignment);
+#endif
+		if (p == nullptr) throw std::bad_alloc();
+		return p;
+	}
+	void Deallocate(void* p, size_t, size_t) override
+	{
+#if defined(_MSC_VER)
+		_aligned_free(p);
+#else
+		std::free(p);
+#endif
+	}
+};
+
+//threshold以上の大きな領域を2MiB境界に揃えてmmapし、transparent huge pageを要求する（madvise(MADV_HUGEPAGE)）。
+//大きな行列を走査する際のTLBミスを減らす。thresholdより小さい領域と、Linux以外ではAlignedResourceと同じ。
+class HugePageResource : public MemoryResource
+{
+public:
+	static constexpr size_t msHugePageSize = 2 * 1024 * 1024;
+
+	explicit HugePageResource(size_t threshold = msHugePageSize)
+		: mThreshold(threshold)
+	{}
+
+	void* Allocate(size_t bytes, size_t alignment) override
+	{
+#if defined(__linux__)
+		if (bytes >= mThreshold && alignment <= msHugePageSize)
+		{
+			size_t size = GetMappedSize(bytes);
+			//余分に確保して2MiB境界に揃え、前後の余りを返す。
+			char* p = (char*)mmap(nullptr, size + msHugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (p == (char*)MAP_FAILED) throw std::bad_alloc();
+			char* q = (char*)(((uintptr_t)p + msHugePageSize - 1) / msHugePageSize * msHugePageSize);
+			if (q != p) munmap(p, q - p);
+			munmap(q + size, p + msHugePageSize - q);
+			madvise(q, size, MADV_HUGEPAGE);
+			return q;
+		}
+#endif
+		return mSmall.Allocate(bytes, alignment);
+	}
+	void Deallocate(void* p, size_t bytes, size_t alignment) override
+	{
+#if defined(__linux__)
+		if (bytes >= mThreshold && alignment <= msHugePageSize)
+		{
+			munmap(p, GetMappedSize(bytes));
+			return;
+		}
+#endif
+		mSmall.Deallocate(p, bytes, alignment);
+	}
+
+private:
+
+	static size_t GetMappedSize(size_t bytes) { return (bytes + msHugePageSize - 1) / msHugePageSize * msHugePageSize; }
+
+	size_t mThreshold;
+	AlignedResource mSmall;
+};
+
+//upstreamから確保したチャンクを先頭から切り出していく。Deallocateは何もせず、Resetでまとめて再利用可能にする。
+//フレームごとに作り直す一時的な行列などに用いる。
+//Resetやデストラクタの時点で、このArenaから確保されたオブジェクトは全て破棄されていなければならない。
+//スレッドセーフではない。
+class ArenaResource : public MemoryResource
+{
+public:
+
+	explicit ArenaResource(size_t chunksize = 4 * 1024 * 1024, MemoryResource* upstream = nullptr);
+	ArenaResource(const ArenaResource&) = delete;
+	ArenaResource& operator=(const ArenaResource&) = delete;
+	~ArenaResource()
+	{
+		Release();
+	}
+
+	void* Allocate(size_t bytes, size_t alignment) override
+	{
+		for (; mCurrent < mChunks.size(); ++mCurrent, mOffset = 0)
+		{
+			Chunk& c = mChunks[mCurrent];
+			uintptr_t base = (uintptr_t)c.mData;
+			size_t offset = ((base + mOffset + alignment - 1) / alignment * alignment) - base;
+			if (offset + bytes <= c.mSize)
+			{
+				mOffset = offset + bytes;
+				mUsed += bytes;
+				return c.mData + offset;
+			}
+		}
+		//どのチャンクにも収まらなければ新たに確保する。Reset後は同じ順で確保すれば同じチャンクが使われる。
+		size_t size = std::max(mChunkSize, bytes);
+		size_t align = std::max<size_t>(alignment, 64);
+		mChunks.push_back({ (char*)mUpstream->Allocate(size, align), size, align });
+		mCurrent = mChunks.size() - 1;
+		mOffset = bytes;
+		mUsed += bytes;
+		return mChunks.back().mData;
+	}
+	void Deallocate(void*, size_t, size_t) override {}
+
+	//確保済みのチャンクを保持したまま、全て未使用に戻す。
+	void Reset()
+	{
+		mCurrent = 0;
+		mOffset = 0;
+		mUsed = 0;
+	}
+	//チャンクを全てupstreamへ返す。
+	void Release()
+	{
+		for (auto& c : mChunks) mUpstream->Deallocate(c.mData, c.mSize, c.mAlignment);
+		mChunks.clear();
+		Reset();
+	}
+	//前回のReset以降に確保されたバイト数と、チャンクの合計バイト数。
+	size_t GetUsedBytes() const { return mUsed; }
+	size_t GetReservedBytes() const
+	{
+		size_t n = 0;
+		for (auto& c : mChunks) n += c.mSize;
+		return n;
+	}
+
+private:
+
+	struct Chunk
+	{
+		char* mData;
+		size_t mSize;
+		size_t mAlignment;
+	};
+	size_t mChunkSize;
+	MemoryResource* mUpstream;
+	std::vector<Chunk> mChunks;
+	size_t mCurrent = 0;
+	size_t mOffset = 0;
+	size_t mUsed = 0;
+};
+
+//解放された領域を大きさごとに保持し、同じ大きさの確保に再利用する。スレッドセーフ。
+//同じ大きさの行列を繰り返し作っては破棄する場合に、upstreamへの確保と解放を省く。
+class PoolResource : public MemoryResource
+{
+public:
+
+	explicit PoolResource(MemoryResource* upstream = nullptr);
+	PoolResource(const PoolResource&) = delete;
+	PoolResource& operator=(const PoolResource&) = delete;
+	~PoolResource()
+	{
+		Release();
+	}
+
+	void* Allocate(size_t bytes, size_t alignment) override
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			auto it = mFree.find({ bytes, alignment });
+			if (it != mFree.end() && !it->second.empty())
+			{
+				void* p = it->second.back();
+				it->second.pop_back();
+				return p;
+			}
+		}
+		return mUpstream->Allocate(bytes, alignment);
+	}
+	void Deallocate(void* p, size_t bytes, size_t alignment) override
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mFree[{ bytes, alignment }].push_back(p);
+	}
+	//保持している未使用の領域を全てupstreamへ返す。
+	void Release()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for (auto& f : mFree)
+			for (void* p : f.second) mUpstream->Deallocate(p, f.first.first, f.first.second);
+		mFree.clear();
+	}
+
+private:
+
+	MemoryResource* mUpstream;
+	std::mutex mMutex;
+	std::map<std::pair<size_t, size_t>, std::vector<void*>> mFree;
+};
+
+namespace detail
+{
+
+template <class = void>
+struct MemoryConfig
+{
+	static AlignedResource msAligned;
+	static MemoryResource* msDefault;
+	static thread_local MemoryResource* msCurrent;//MemoryResourceScopeで設定されたもの。
+};
+template <class T>
+AlignedResource MemoryConfig<T>::msAligned;
+template <class T>
+MemoryResource* MemoryConfig<T>::msDefault = &MemoryConfig<T>::msAligned;
+template <class T>
+thread_local MemoryResource* MemoryConfig<T>::msCurrent = nullptr;
+
+}
+
+inline AlignedResource* GetAlignedResource() { return &detail::MemoryConfig<>::msAligned; }
+
+//全スレッドで用いられる既定のメモリ資源を設定する。nullptrを与えるとAlignedResourceに戻る。
+inline void SetDefaultMemoryResource(MemoryResource* r)
+{
+	detail::MemoryConfig<>::msDefault = r ? r : GetAlignedResource();
+}
+//新たに確保される領域に用いられるメモリ資源。このスレッドのMemoryResourceScopeが優先される。
+inline MemoryResource* GetMemoryResource()
+{
+	MemoryResource* r = detail::MemoryConfig<>::msCurrent;
+	return r ? r : detail::MemoryConfig<>::msDefault;
+}
+
+//生存期間中、このスレッドで確保される領域にrを用いる。入れ子にできる。
+//確保された領域は確保したメモリ資源へ返されるので、解放の時点でScopeが残っている必要はない。
+class MemoryResourceScope
+{
+public:
+	explicit MemoryResourceScope(MemoryResource* r)
+		: mPrev(detail::MemoryConfig<>::msCurrent)
+	{
+		detail::MemoryConfig<>::msCurrent = r;
+	}
+	MemoryResourceScope(const MemoryResourceScope&) = delete;
+	MemoryResourceScope& operator=(const MemoryResourceScope&) = delete;
+	~MemoryResourceScope()
+	{
+		detail::MemoryConfig<>::msCurrent = mPrev;
+	}
+private:
+	MemoryResource* mPrev;
+};
+
+inline ArenaResource::ArenaResource(size_t chunksize, MemoryResource* upstream)
+	: mChunkSize(chunksize), mUpstream(upstream ? upstream : GetAlignedResource())
+{}
+inline PoolResource::PoolResource(MemoryResource* upstream)
+	: mUpstream(upstream ? upstream : GetAlignedResource())
+{}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef CUF_PARALLEL_H
+#define CUF_PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <exception>
+#include <iterator>
+#include <array>
+
+namespace adapt
+{
+
+inline namespace cuf
+{
+
+namespace detail
+{
+template <class = void>
+struct ParallelConfig
+{
+	static unsigned int msNumThreads;//0ならstd::thread::hardware_concurrency()に従う。
+};
+template <class T>
+unsigned int ParallelConfig<T>::msNumThreads = 0;
+}
+
+//ParallelFor、ParallelSortなどが利用するスレッド数を設定する。0を与えるとハードウェアのスレッド数に従う。
+inline void SetNumThreads(unsigned int n)
+{
+	detail::ParallelConfig<>::msNumThreads = n;
+}
+inline unsigned int GetNumThreads()
+{
+	if (detail::ParallelConfig<>::msNumThreads != 0) return detail::ParallelConfig<>::msNumThreads;
+	unsigned int n = std::thread::hardware_concurrency();
+	return n != 0 ? n : 1;
+}
+
+//[begin, end)をGetNumThreads()個程度のブロックに分割し、f(block_begin, block_end, thread_index)を並列に呼ぶ。
+//grain未満のブロックには分割しない。範囲が小さければ呼び出し元のスレッドのみで処理する。
+//fが投げた例外は全スレッドの終了後に呼び出し元で再送出される。
+template <class Func>
+void ParallelFor(size_t begin, size_t end, Func f, size_t grain = 4096)
+{
+	if (end <= begin) return;
+	size_t size = end - begin;
+	size_t nthreads = std::min<size_t>(GetNumThreads(), (size + grain - 1) / std::max<size_t>(grain, 1));
+	if (nthreads <= 1)
+	{
+		f(begin, end, (size_t)0);
+		return;
+	}
+	std::vector<std::thread> threads;
+	std::vector<std::exception_ptr> errors(nthreads);
+	threads.reserve(nthreads - 1);
+	size_t block = size / nthreads;
+	size_t rest = size % nthreads;
+	size_t b = begin;
+	for (size_t t = 0; t < nthreads; ++t)
+	{
+		size_t e = b + block + (t < rest ? 1 : 0);
+		auto task = [&f, &errors, b, e, t]()
+		{
+			try { f(b, e, t); }
+			catch (...) { errors[t] = std::current_exception(); }
+		};
+		//最後のブロックは呼び出し元のスレッドで処理する。
+		if (t + 1 == nthreads) task();
+		else threads.emplace_back(task);
+		b = e;
+	}
+	for (auto& th : threads) th.join();
+	for (auto& e : errors) if (e) std::rethrow_exception(e);
+}
+
+//ブロックごとにstd::sortで並列にソートした後、隣り合うブロックを並列にマージしていく。
+//安定ソートではない。
+template <class RandomIt, class Compare = std::less<>>
+void ParallelSort(RandomIt first, RandomIt last, Compare comp = Compare(), size_t grain = 1 << 16)
+{
+	size_t size = (size_t)std::distance(first, last);
+	size_t nblocks = std::min<size_t>(GetNumThreads(), size / std::max<size_t>(grain, 1));
+	if (nblocks <= 1)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+	std::vector<size_t> bounds(nblocks + 1);
+	for (size_t i = 0; i <= nblocks; ++i) bounds[i] = size * i / nblocks;
+	ParallelFor(0, nblocks, [&](size_t b, size_t e, size_t)
+	{
+		for (size_t i = b; i < e; ++i) std::sort(first + bounds[i], first + bounds[i + 1], comp);
+	}, 1);
+	//マージ済みの区間の幅を倍々にしながら、隣り合う区間同士を並列にマージする。
+	for (size_t width = 1; width < nblocks; width *= 2)
+	{
+		size_t npairs = (nblocks + 2 * width - 1) / (2 * width);
+		ParallelFor(0, npairs, [&](size_t b, size_t e, size_t)
+		{
+			for (size_t i = b; i < e; ++i)
+			{
+				size_t lo = 2 * width * i;
+				size_t mid = std::min(lo + width, nblocks);
+				size_t hi = std::min(lo + 2 * width, nblocks);
+				if (mid == hi) continue;
+				std::inplace_merge(first + bounds[lo], first + bounds[mid], first + bounds[hi], comp);
+			}
+		}, 1);
+	}
+}
+
+//std::nth_elementの並列版。
+//等間隔に抽出した標本からnth番目の値を挟む2つのピボットを選び、範囲をピボットの下、間、上の3つに並列に振り分けてから、
+//間の区間のみをstd::nth_elementで確定させる。ピボットがnth番目の値を挟めなかった場合はstd::nth_elementで処理する。
+//振り分けのために範囲と同じ大きさの一時領域を使う。
+template <class RandomIt, class Compare = std::less<>>
+void ParallelNthElement(RandomIt first, RandomIt nth, RandomIt last, Compare comp = Compare(), size_t grain = 1 << 16)
+{
+	using Type = typename std::iterator_traits<RandomIt>::value_type;
+	size_t size = (size_t)std::distance(first, last);
+	size_t nblocks = std::min<size_t>(GetNumThreads(), size / std::max<size_t>(grain, 1));
+	if (nblocks <= 1 || nth == last)
+	{
+		std::nth_element(first, nth, last, comp);
+		return;
+	}
+	size_t k = (size_t)std::distance(first, nth);
+
+	const size_t nsample = 4096;
+	const size_t margin = 192;//標本の標準偏差sqrt(nsample)の3倍程度。
+	std::vector<Type> sample(nsample);
+	for (size_t i = 0; i < nsample; ++i) sample[i] = first[i * size / nsample];
+	std::sort(sample.begin(), sample.end(), comp);
+	size_t pos = k * nsample / size;
+	bool haslo = pos >= margin;
+	bool hashi = pos + margin < nsample;
+	Type lo = haslo ? sample[pos - margin] : Type();
+	Type hi = hashi ? sample[pos + margin] : Type();
+	auto category = [&](const Type& v) -> int
+	{
+		if (haslo && comp(v, lo)) return 0;
+		if (hashi && comp(hi, v)) return 2;
+		return 1;
+	};
+
+	std::vector<size_t> bounds(nblocks + 1);
+	for (size_t i = 0; i <= nblocks; ++i) bounds[i] = size * i / nblocks;
+	std::vector<std::array<size_t, 3>> counts(nblocks, std::array<size_t, 3>{ 0, 0, 0 });
+	ParallelFor(0, nblocks, [&](size_t b, size_t e, size_t)
+	{
+		for (size_t i = b; i < e; ++i)
+			for (size_t j = bounds[i]; j < bounds[i + 1]; ++j) ++counts[i][category(first[j])];
+	}, 1);
+	size_t nlo = 0, nmid = 0;
+	for (auto& c : counts) nlo += c[0], nmid += c[1];
+	if (k < nlo || k >= nlo + nmid)
+	{
+		std::nth_element(first, nth, last, comp);
+		return;
+	}
+
+	//各ブロックの書き込み先を決めてから並列に振り分ける。
+	std::vector<std::array<size_t, 3>> offsets(nblocks);
+	std::array<size_t, 3> pos3 = { 0, nlo, nlo + nmid };
+	for (size_t i = 0; i < nblocks; ++i)
+	{
+		offsets[i] = pos3;
+		for (int c = 0; c < 3; ++c) pos3[c] += counts[i][c];
+	}
+	std::vector<Type> buf(size);
+	ParallelFor(0, nblocks, [&](size_t b, size_t e, size_t)
+	{
+		for (size_t i = b; i < e; ++i)
+		{
+			auto o = offsets[i];
+			for (size_t j = bounds[i]; j < bounds[i + 1]; ++j) buf[o[category(first[j])]++] = std::move(first[j]);
+		}
+	}, 1);
+	std::nth_element(buf.begin() + nlo, buf.begin() + k, buf.begin() + nlo + nmid, comp);
+	ParallelFor(0, nblocks, [&](size_t b, size_t e, size_t)
+	{
+		std::move(buf.begin() + bounds[b], buf.begin() + bounds[e], first + bounds[b]);
+	}, 1);
+}
+
+}
+
+}
+
+#endif
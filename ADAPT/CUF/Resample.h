@@ -0,0 +1,176 @@
+#ifndef CUF_RESAMPLE_H
+#define CUF_RESAMPLE_H
+
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <ADAPT/CUF/Matrix.h>
+#include <ADAPT/CUF/MatrixView.h>
+#include <ADAPT/CUF/Parallel.h>
+#include <ADAPT/CUF/Exception.h>
+
+namespace adapt
+{
+
+inline namespace cuf
+{
+
+//nearest  : 出力の各セルの中心に最も近い入力のセル。
+//bilinear : 出力の各セルの中心での、入力の隣接する4セルからの双線形補間。
+//mean, max, min : 出力の各セルが覆う入力のセルの平均、最大、最小。縮小に用いる。
+//mean、max、minではNaNを無視し、全てNaNであればNaNとする。
+enum class ResampleMethod { nearest, bilinear, mean, max, min, };
+
+//Resampleの結果の要素の型。浮動小数点数はそのまま、整数はdoubleとする。
+template <class T>
+using ResampleResultT = std::conditional_t<std::is_floating_point<T>::value, T, double>;
+
+namespace detail
+{
+
+//出力のi番目のセルが覆う入力のセルの範囲[begin, end)。拡大する場合も1セル以上を含む。
+inline std::pair<uint32_t, uint32_t> GetResampleBlock(uint32_t i, uint32_t src, uint32_t dst)
+{
+	uint32_t b = (uint32_t)((uint64_t)i * src / dst);
+	uint32_t e = (uint32_t)((uint64_t)(i + 1) * src / dst);
+	return { b, std::max(e, b + 1) };
+}
+//出力のi番目のセルの中心に最も近い入力のセル。
+inline uint32_t GetResampleNearest(uint32_t i, uint32_t src, uint32_t dst)
+{
+	return std::min((uint32_t)(((uint64_t)i * 2 + 1) * src / ((uint64_t)dst * 2)), src - 1);
+}
+//出力のi番目のセルの中心の位置を、入力のセルの中心を整数として表す。範囲外は端のセルに揃える。
+inline double GetResamplePosition(uint32_t i, uint32_t src, uint32_t dst)
+{
+	double u = ((double)i + 0.5) * src / dst - 0.5;
+	return std::clamp(u, 0., (double)src - 1.);
+}
+
+}
+
+//2次元のビューをxsize×ysizeの行列に変換する。出力の行（最初の次元）をParallelForで分割して並列に計算する。
+//入力と出力は同じ範囲を覆うとみなす。すなわち出力の1セルは入力のGetSize(0)/xsize×GetSize(1)/ysizeセルに相当する。
+template <class T>
+Matrix<ResampleResultT<std::remove_const_t<T>>> Resample(const MatrixView<T, 2>& src, uint32_t xsize, uint32_t ysize,
+														 ResampleMethod method = ResampleMethod::mean)
+{
+	using Value = std::remove_const_t<T>;
+	using Result = ResampleResultT<Value>;
+	static_assert(std::is_arithmetic<Value>::value, "Resample supports arithmetic element types only");
+	uint32_t sx = src.GetSize(0);
+	uint32_t sy = src.GetSize(1);
+	Matrix<Result> res(xsize, ysize);
+	if (xsize == 0 || ysize == 0) return res;
+	if (sx == 0 || sy == 0) throw InvalidArg("an empty matrix cannot be resampled.");
+
+	//y方向の対応は全ての行で同じなので、先に求めておく。
+	std::vector<uint32_t> yb(ysize), ye(ysize);
+	std::vector<double> wy(ysize);
+	for (uint32_t oy = 0; oy < ysize; ++oy)
+	{
+		switch (method)
+		{
+		case ResampleMethod::nearest:
+			yb[oy] = detail::GetResampleNearest(oy, sy, ysize);
+			break;
+		case ResampleMethod::bilinear:
+		{
+			double u = detail::GetResamplePosition(oy, sy, ysize);
+			yb[oy] = std::min((uint32_t)u, sy - 1);
+			ye[oy] = std::min(yb[oy] + 1, sy - 1);
+			wy[oy] = u - yb[oy];
+			break;
+		}
+		default:
+			std::tie(yb[oy], ye[oy]) = detail::GetResampleBlock(oy, sy, ysize);
+			break;
+		}
+	}
+	const Value* data = src.GetData();
+	ptrdiff_t s0 = src.GetStride(0);
+	ptrdiff_t s1 = src.GetStride(1);
+	auto at = [data, s0, s1](uint32_t ix, uint32_t iy) { return (double)data[ix * s0 + iy * s1]; };
+
+	//出力の1行あたりの読み出し量から、スレッドに割り振る最小の行数を決める。
+	size_t work = (size_t)(sx / xsize + 1) * sy;
+	ParallelFor(0, xsize, [&](size_t begin, size_t end, size_t)
+	{
+		std::vector<double> acc;
+		std::vector<uint32_t> count;
+		for (uint32_t ox = (uint32_t)begin; ox < (uint32_t)end; ++ox)
+		{
+			Result* out = res.begin() + (size_t)ox * ysize;
+			switch (method)
+			{
+			case ResampleMethod::nearest:
+			{
+				uint32_t ix = detail::GetResampleNearest(ox, sx, xsize);
+				for (uint32_t oy = 0; oy < ysize; ++oy) out[oy] = (Result)at(ix, yb[oy]);
+				break;
+			}
+			case ResampleMethod::bilinear:
+			{
+				double u = detail::GetResamplePosition(ox, sx, xsize);
+				uint32_t ix0 = std::min((uint32_t)u, sx - 1);
+				uint32_t ix1 = std::min(ix0 + 1, sx - 1);
+				double wx = u - ix0;
+				for (uint32_t oy = 0; oy < ysize; ++oy)
+				{
+					double v0 = at(ix0, yb[oy]) * (1. - wy[oy]) + at(ix0, ye[oy]) * wy[oy];
+					double v1 = at(ix1, yb[oy]) * (1. - wy[oy]) + at(ix1, ye[oy]) * wy[oy];
+					out[oy] = (Result)(v0 * (1. - wx) + v1 * wx);
+				}
+				break;
+			}
+			default:
+			{
+				//入力の行を順に読み、出力の各セルへ集計する。
+				acc.assign(ysize, 0.);
+				count.assign(ysize, 0);
+				auto [bx, ex] = detail::GetResampleBlock(ox, sx, xsize);
+				for (uint32_t ix = bx; ix < ex; ++ix)
+				{
+					for (uint32_t oy = 0; oy < ysize; ++oy)
+					{
+						double& a = acc[oy];
+						uint32_t& c = count[oy];
+						for (uint32_t iy = yb[oy]; iy < ye[oy]; ++iy)
+						{
+							double v = at(ix, iy);
+							if (std::isnan(v)) continue;
+							if (method == ResampleMethod::mean) a += v;
+							else if (c == 0) a = v;
+							else if (method == ResampleMethod::max) a = std::max(a, v);
+							else a = std::min(a, v);
+							++c;
+						}
+					}
+				}
+				for (uint32_t oy = 0; oy < ysize; ++oy)
+				{
+					if (count[oy] == 0) out[oy] = std::numeric_limits<Result>::quiet_NaN();
+					else if (method == ResampleMethod::mean) out[oy] = (Result)(acc[oy] / count[oy]);
+					else out[oy] = (Result)acc[oy];
+				}
+				break;
+			}
+			}
+		}
+	}, std::max<size_t>(1, (1 << 16) / work));
+	return res;
+}
+template <class T>
+Matrix<ResampleResultT<T>> Resample(const Matrix<T>& src, uint32_t xsize, uint32_t ysize, ResampleMethod method = ResampleMethod::mean)
+{
+	return Resample(MakeView(src), xsize, ysize, method);
+}
+
+}
+
+}
+
+#endif
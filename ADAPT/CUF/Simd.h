@@ -0,0 +1,425 @@
+#ifndef CUF_SIMD_H
+#define CUF_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <atomic>
+
+//doubleとfloatの配列に対する要素ごとの演算と集計を、実行時に選んだ命令セット（AVX-512、AVX2、スカラー）で行う。
+//x86以外の環境や、CUF_DISABLE_SIMDが定義されている場合はスカラー版のみとなる。
+#if !defined(CUF_DISABLE_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64))
+#define CUF_SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CUF_SIMD_TARGET(isa)
+#else
+#define CUF_SIMD_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace adapt
+{
+
+inline namespace cuf
+{
+
+enum class SimdLevel { scalar, avx2, avx512, };
+
+namespace detail
+{
+
+template <class = void>
+struct SimdConfig
+{
+	//-1なら未判定。ParallelForの各スレッドから最初に呼ばれることがあるのでatomicとする。
+	static std::atomic<int> msLevel;
+};
+template <class T>
+std::atomic<int> SimdConfig<T>::msLevel{ -1 };
+
+inline SimdLevel GetSupportedSimdLevel()
+{
+#if defined(CUF_SIMD_X86)
+#if defined(_MSC_VER) && !defined(__clang__)
+	int r[4];
+	__cpuid(r, 1);
+	if ((r[2] & (1 << 27)) == 0) return SimdLevel::scalar;//OSXSAVE
+	unsigned long long xcr0 = _xgetbv(0);
+	if ((xcr0 & 6) != 6) return SimdLevel::scalar;
+	__cpuidex(r, 7, 0);
+	if ((r[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) return SimdLevel::avx512;
+	if (r[1] & (1 << 5)) return SimdLevel::avx2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) return SimdLevel::avx512;
+	if (__builtin_cpu_supports("avx2")) return SimdLevel::avx2;
+#endif
+#endif
+	return SimdLevel::scalar;
+}
+
+}
+
+//SimdKernelsが用いる命令セット。既定ではCPUが対応する最上位のもの。
+inline SimdLevel GetSimdLevel()
+{
+	//複数のスレッドが同時に判定しても、同じ値を書き込むだけである。
+	int level = detail::SimdConfig<>::msLevel.load(std::memory_order_relaxed);
+	if (level < 0)
+	{
+		level = (int)detail::GetSupportedSimdLevel();
+		detail::SimdConfig<>::msLevel.store(level, std::memory_order_relaxed);
+	}
+	return (SimdLevel)level;
+}
+//ベンチマークや検証のために命令セットを制限する。CPUが対応していないものを与えた場合は対応する最上位のものになる。
+inline void SetSimdLevel(SimdLevel level)
+{
+	detail::SimdConfig<>::msLevel.store((int)std::min(level, detail::GetSupportedSimdLevel()), std::memory_order_relaxed);
+}
+
+namespace detail
+{
+
+namespace simd
+{
+
+//スカラー版。ベクトル版の端数の処理にも用いる。
+namespace scalar
+{
+
+template <class T>
+void Multiply(T* p, size_t n, T x) { for (size_t i = 0; i < n; ++i) p[i] *= x; }
+template <class T>
+void Divide(T* p, size_t n, T x) { for (size_t i = 0; i < n; ++i) p[i] /= x; }
+template <class T>
+void Add(T* p, const T* q, size_t n) { for (size_t i = 0; i < n; ++i) p[i] += q[i]; }
+template <class T>
+void Subtract(T* p, const T* q, size_t n) { for (size_t i = 0; i < n; ++i) p[i] -= q[i]; }
+//NaNは無視する。
+template <class T>
+void MinMax(const T* p, size_t n, T& min, T& max)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (p[i] < min) min = p[i];
+		if (p[i] > max) max = p[i];
+	}
+}
+template <class T>
+double Sum(const T* p, size_t n)
+{
+	double s = 0.;
+	for (size_t i = 0; i < n; ++i) s += p[i];
+	return s;
+}
+template <class T>
+size_t CountNonFinite(const T* p, size_t n)
+{
+	size_t c = 0;
+	for (size_t i = 0; i < n; ++i) c += !std::isfinite(p[i]);
+	return c;
+}
+
+}
+
+#if defined(CUF_SIMD_X86)
+
+//_mm_popcnt_u32はclangではpopcntのtargetを要求するが、avx2、avx512fはこれを含まないので、組み込み関数を用いる。
+inline size_t PopCount(unsigned x)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	return (size_t)__popcnt(x);
+#else
+	return (size_t)__builtin_popcount(x);
+#endif
+}
+
+//命令セットと要素型ごとのレジスタ操作。
+//Accumulateはdoubleの累積レジスタ2本に加算する（floatは倍精度に変換して足す）。
+struct Avx2Double
+{
+	using Type = double;
+	using Reg = __m256d;
+	using SumReg = __m256d;
+	static constexpr size_t N = 4;
+	CUF_SIMD_TARGET("avx2") static Reg Load(const double* p) { return _mm256_loadu_pd(p); }
+	CUF_SIMD_TARGET("avx2") static void Store(double* p, Reg x) { _mm256_storeu_pd(p, x); }
+	CUF_SIMD_TARGET("avx2") static Reg Set(double x) { return _mm256_set1_pd(x); }
+	CUF_SIMD_TARGET("avx2") static Reg Mul(Reg a, Reg b) { return _mm256_mul_pd(a, b); }
+	CUF_SIMD_TARGET("avx2") static Reg Div(Reg a, Reg b) { return _mm256_div_pd(a, b); }
+	CUF_SIMD_TARGET("avx2") static Reg Add(Reg a, Reg b) { return _mm256_add_pd(a, b); }
+	CUF_SIMD_TARGET("avx2") static Reg Sub(Reg a, Reg b) { return _mm256_sub_pd(a, b); }
+	//_mm256_min_pdはどちらかがNaNなら第2引数を返すので、累積値を第2引数にすればNaNは無視される。
+	CUF_SIMD_TARGET("avx2") static Reg Min(Reg x, Reg acc) { return _mm256_min_pd(x, acc); }
+	CUF_SIMD_TARGET("avx2") static Reg Max(Reg x, Reg acc) { return _mm256_max_pd(x, acc); }
+	CUF_SIMD_TARGET("avx2") static size_t CountNonFinite(Reg x)
+	{
+		Reg t = _mm256_sub_pd(x, x);//有限ならば0、そうでなければNaN。
+		return PopCount((unsigned)_mm256_movemask_pd(_mm256_cmp_pd(t, t, _CMP_UNORD_Q)));
+	}
+	CUF_SIMD_TARGET("avx2") static SumReg ZeroSum() { return _mm256_setzero_pd(); }
+	CUF_SIMD_TARGET("avx2") static void Accumulate(SumReg& a0, SumReg&, Reg x) { a0 = _mm256_add_pd(a0, x); }
+	CUF_SIMD_TARGET("avx2") static void Spill(Reg x, double* out) { _mm256_storeu_pd(out, x); }
+	CUF_SIMD_TARGET("avx2") static void SpillSum(SumReg x, double* out) { _mm256_storeu_pd(out, x); }
+	static constexpr size_t SumN = 4;
+};
+struct Avx2Float
+{
+	using Type = float;
+	using Reg = __m256;
+	using SumReg = __m256d;
+	static constexpr size_t N = 8;
+	CUF_SIMD_TARGET("avx2") static Reg Load(const float* p) { return _mm256_loadu_ps(p); }
+	CUF_SIMD_TARGET("avx2") static void Store(float* p, Reg x) { _mm256_storeu_ps(p, x); }
+	CUF_SIMD_TARGET("avx2") static Reg Set(float x) { return _mm256_set1_ps(x); }
+	CUF_SIMD_TARGET("avx2") static Reg Mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+	CUF_SIMD_TARGET("avx2") static Reg Div(Reg a, Reg b) { return _mm256_div_ps(a, b); }
+	CUF_SIMD_TARGET("avx2") static Reg Add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+	CUF_SIMD_TARGET("avx2") static Reg Sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+	CUF_SIMD_TARGET("avx2") static Reg Min(Reg x, Reg acc) { return _mm256_min_ps(x, acc); }
+	CUF_SIMD_TARGET("avx2") static Reg Max(Reg x, Reg acc) { return _mm256_max_ps(x, acc); }
+	CUF_SIMD_TARGET("avx2") static size_t CountNonFinite(Reg x)
+	{
+		Reg t = _mm256_sub_ps(x, x);
+		return PopCount((unsigned)_mm256_movemask_ps(_mm256_cmp_ps(t, t, _CMP_UNORD_Q)));
+	}
+	CUF_SIMD_TARGET("avx2") static SumReg ZeroSum() { return _mm256_setzero_pd(); }
+	CUF_SIMD_TARGET("avx2") static void Accumulate(SumReg& a0, SumReg& a1, Reg x)
+	{
+		a0 = _mm256_add_pd(a0, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+		a1 = _mm256_add_pd(a1, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+	}
+	CUF_SIMD_TARGET("avx2") static void Spill(Reg x, float* out) { _mm256_storeu_ps(out, x); }
+	CUF_SIMD_TARGET("avx2") static void SpillSum(SumReg x, double* out) { _mm256_storeu_pd(out, x); }
+	static constexpr size_t SumN = 4;
+};
+struct Avx512Double
+{
+	using Type = double;
+	using Reg = __m512d;
+	using SumReg = __m512d;
+	static constexpr size_t N = 8;
+	CUF_SIMD_TARGET("avx512f") static Reg Load(const double* p) { return _mm512_loadu_pd(p); }
+	CUF_SIMD_TARGET("avx512f") static void Store(double* p, Reg x) { _mm512_storeu_pd(p, x); }
+	CUF_SIMD_TARGET("avx512f") static Reg Set(double x) { return _mm512_set1_pd(x); }
+	CUF_SIMD_TARGET("avx512f") static Reg Mul(Reg a, Reg b) { return _mm512_mul_pd(a, b); }
+	CUF_SIMD_TARGET("avx512f") static Reg Div(Reg a, Reg b) { return _mm512_div_pd(a, b); }
+	CUF_SIMD_TARGET("avx512f") static Reg Add(Reg a, Reg b) { return _mm512_add_pd(a, b); }
+	CUF_SIMD_TARGET("avx512f") static Reg Sub(Reg a, Reg b) { return _mm512_sub_pd(a, b); }
+	//GCC 12のヘッダでは_mm512_min_pdなどマスクなしの一部の命令が未初期化の警告を出すので、
+	//minとmaxは比較とblendで（NaNとの比較は偽なのでaccが残る）、変換と抽出はマスク付きの命令で書く。
+	CUF_SIMD_TARGET("avx512f") static Reg Min(Reg x, Reg acc) { return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, acc, _CMP_LT_OQ), acc, x); }
+	CUF_SIMD_TARGET("avx512f") static Reg Max(Reg x, Reg acc) { return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(x, acc, _CMP_GT_OQ), acc, x); }
+	CUF_SIMD_TARGET("avx512f") static size_t CountNonFinite(Reg x)
+	{
+		Reg t = _mm512_sub_pd(x, x);
+		return PopCount((unsigned)_mm512_cmp_pd_mask(t, t, _CMP_UNORD_Q));
+	}
+	CUF_SIMD_TARGET("avx512f") static SumReg ZeroSum() { return _mm512_setzero_pd(); }
+	CUF_SIMD_TARGET("avx512f") static void Accumulate(SumReg& a0, SumReg&, Reg x) { a0 = _mm512_add_pd(a0, x); }
+	CUF_SIMD_TARGET("avx512f") static void Spill(Reg x, double* out) { _mm512_storeu_pd(out, x); }
+	CUF_SIMD_TARGET("avx512f") static void SpillSum(SumReg x, double* out) { _mm512_storeu_pd(out, x); }
+	static constexpr size_t SumN = 8;
+};
+struct Avx512Float
+{
+	using Type = float;
+	using Reg = __m512;
+	using SumReg = __m512d;
+	static constexpr size_t N = 16;
+	CUF_SIMD_TARGET("avx512f") static Reg Load(const float* p) { return _mm512_loadu_ps(p); }
+	CUF_SIMD_TARGET("avx512f") static void Store(float* p, Reg x) { _mm512_storeu_ps(p, x); }
+	CUF_SIMD_TARGET("avx512f") static Reg Set(float x) { return _mm512_set1_ps(x); }
+	CUF_SIMD_TARGET("avx512f") static Reg Mul(Reg a, Reg b) { return _mm512_mul_ps(a, b); }
+	CUF_SIMD_TARGET("avx512f") static Reg Div(Reg a, Reg b) { return _mm512_div_ps(a, b); }
+	CUF_SIMD_TARGET("avx512f") static Reg Add(Reg a, Reg b) { return _mm512_add_ps(a, b); }
+	CUF_SIMD_TARGET("avx512f") static Reg Sub(Reg a, Reg b) { return _mm512_sub_ps(a, b); }
+	CUF_SIMD_TARGET("avx512f") static Reg Min(Reg x, Reg acc) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, acc, _CMP_LT_OQ), acc, x); }
+	CUF_SIMD_TARGET("avx512f") static Reg Max(Reg x, Reg acc) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(x, acc, _CMP_GT_OQ), acc, x); }
+	CUF_SIMD_TARGET("avx512f") static size_t CountNonFinite(Reg x)
+	{
+		Reg t = _mm512_sub_ps(x, x);
+		return PopCount((unsigned)_mm512_cmp_ps_mask(t, t, _CMP_UNORD_Q));
+	}
+	CUF_SIMD_TARGET("avx512f") static SumReg ZeroSum() { return _mm512_setzero_pd(); }
+	CUF_SIMD_TARGET("avx512f") static void Accumulate(SumReg& a0, SumReg& a1, Reg x)
+	{
+		__m256 lo = _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xf, _mm512_castps_pd(x), 0));
+		__m256 hi = _mm256_castpd_ps(_mm512_mask_extractf64x4_pd(_mm256_setzero_pd(), 0xf, _mm512_castps_pd(x), 1));
+		a0 = _mm512_add_pd(a0, _mm512_mask_cvtps_pd(a0, 0xff, lo));
+		a1 = _mm512_add_pd(a1, _mm512_mask_cvtps_pd(a1, 0xff, hi));
+	}
+	CUF_SIMD_TARGET("avx512f") static void Spill(Reg x, float* out) { _mm512_storeu_ps(out, x); }
+	CUF_SIMD_TARGET("avx512f") static void SpillSum(SumReg x, double* out) { _mm512_storeu_pd(out, x); }
+	static constexpr size_t SumN = 8;
+};
+
+//命令セットごとに同じ本体を持つカーネルを定義する。Vは上のレジスタ操作のいずれか。
+//端数はスカラー版で処理する。
+#define CUF_SIMD_DEFINE_KERNELS(ISA)\
+template <class V>\
+CUF_SIMD_TARGET(ISA) void Multiply(typename V::Type* p, size_t n, typename V::Type x)\
+{\
+	size_t i = 0;\
+	auto r = V::Set(x);\
+	for (; i + V::N <= n; i += V::N) V::Store(p + i, V::Mul(V::Load(p + i), r));\
+	scalar::Multiply(p + i, n - i, x);\
+}\
+template <class V>\
+CUF_SIMD_TARGET(ISA) void Divide(typename V::Type* p, size_t n, typename V::Type x)\
+{\
+	size_t i = 0;\
+	auto r = V::Set(x);\
+	for (; i + V::N <= n; i += V::N) V::Store(p + i, V::Div(V::Load(p + i), r));\
+	scalar::Divide(p + i, n - i, x);\
+}\
+template <class V>\
+CUF_SIMD_TARGET(ISA) void Add(typename V::Type* p, const typename V::Type* q, size_t n)\
+{\
+	size_t i = 0;\
+	for (; i + V::N <= n; i += V::N) V::Store(p + i, V::Add(V::Load(p + i), V::Load(q + i)));\
+	scalar::Add(p + i, q + i, n - i);\
+}\
+template <class V>\
+CUF_SIMD_TARGET(ISA) void Subtract(typename V::Type* p, const typename V::Type* q, size_t n)\
+{\
+	size_t i = 0;\
+	for (; i + V::N <= n; i += V::N) V::Store(p + i, V::Sub(V::Load(p + i), V::Load(q + i)));\
+	scalar::Subtract(p + i, q + i, n - i);\
+}\
+template <class V>\
+CUF_SIMD_TARGET(ISA) void MinMax(const typename V::Type* p, size_t n, typename V::Type& min, typename V::Type& max)\
+{\
+	using T = typename V::Type;\
+	size_t i = 0;\
+	auto mn0 = V::Set(min), mn1 = mn0, mx0 = V::Set(max), mx1 = mx0;\
+	for (; i + 2 * V::N <= n; i += 2 * V::N)\
+	{\
+		auto a = V::Load(p + i), b = V::Load(p + i + V::N);\
+		mn0 = V::Min(a, mn0); mn1 = V::Min(b, mn1);\
+		mx0 = V::Max(a, mx0); mx1 = V::Max(b, mx1);\
+	}\
+	T buf[2][V::N];\
+	V::Spill(V::Min(mn0, mn1), buf[0]);\
+	V::Spill(V::Max(mx0, mx1), buf[1]);\
+	for (size_t k = 0; k < V::N; ++k)\
+	{\
+		if (buf[0][k] < min) min = buf[0][k];\
+		if (buf[1][k] > max) max = buf[1][k];\
+	}\
+	scalar::MinMax(p + i, n - i, min, max);\
+}\
+template <class V>\
+CUF_SIMD_TARGET(ISA) double Sum(const typename V::Type* p, size_t n)\
+{\
+	size_t i = 0;\
+	auto a0 = V::ZeroSum(), a1 = a0, b0 = a0, b1 = a0;\
+	for (; i + 2 * V::N <= n; i += 2 * V::N)\
+	{\
+		V::Accumulate(a0, a1, V::Load(p + i));\
+		V::Accumulate(b0, b1, V::Load(p + i + V::N));\
+	}\
+	double buf[4][V::SumN];\
+	V::SpillSum(a0, buf[0]); V::SpillSum(a1, buf[1]); V::SpillSum(b0, buf[2]); V::SpillSum(b1, buf[3]);\
+	double s = 0.;\
+	for (auto& b : buf) for (double x : b) s += x;\
+	return s + scalar::Sum(p + i, n - i);\
+}\
+template <class V>\
+CUF_SIMD_TARGET(ISA) size_t CountNonFinite(const typename V::Type* p, size_t n)\
+{\
+	size_t i = 0, c = 0;\
+	for (; i + V::N <= n; i += V::N) c += V::CountNonFinite(V::Load(p + i));\
+	return c + scalar::CountNonFinite(p + i, n - i);\
+}
+
+namespace avx2
+{
+CUF_SIMD_DEFINE_KERNELS("avx2")
+template <class T> using Reg = std::conditional_t<std::is_same<T, double>::value, Avx2Double, Avx2Float>;
+}
+namespace avx512
+{
+CUF_SIMD_DEFINE_KERNELS("avx512f")
+template <class T> using Reg = std::conditional_t<std::is_same<T, double>::value, Avx512Double, Avx512Float>;
+}
+
+#undef CUF_SIMD_DEFINE_KERNELS
+
+#endif
+
+}
+
+template <class T>
+constexpr bool IsSimdType = std::is_same<T, double>::value || std::is_same<T, float>::value;
+
+}
+
+//以下はdouble、floatの配列に対する演算。GetSimdLevel()に従って命令セットを選ぶ。その他の型はスカラー版となる。
+#if defined(CUF_SIMD_X86)
+#define CUF_SIMD_DISPATCH(func, T, ...)\
+	if constexpr (detail::IsSimdType<T>)\
+	{\
+		switch (GetSimdLevel())\
+		{\
+		case SimdLevel::avx512: return detail::simd::avx512::func<detail::simd::avx512::Reg<T>>(__VA_ARGS__);\
+		case SimdLevel::avx2: return detail::simd::avx2::func<detail::simd::avx2::Reg<T>>(__VA_ARGS__);\
+		default: break;\
+		}\
+	}\
+	return detail::simd::scalar::func(__VA_ARGS__);
+#else
+#define CUF_SIMD_DISPATCH(func, T, ...) return detail::simd::scalar::func(__VA_ARGS__);
+#endif
+
+//p[i] *= x
+template <class T>
+void SimdMultiply(T* p, size_t n, T x) { CUF_SIMD_DISPATCH(Multiply, T, p, n, x) }
+//p[i] /= x
+template <class T>
+void SimdDivide(T* p, size_t n, T x) { CUF_SIMD_DISPATCH(Divide, T, p, n, x) }
+//p[i] += q[i]
+template <class T>
+void SimdAdd(T* p, const T* q, size_t n) { CUF_SIMD_DISPATCH(Add, T, p, q, n) }
+//p[i] -= q[i]
+template <class T>
+void SimdSubtract(T* p, const T* q, size_t n) { CUF_SIMD_DISPATCH(Subtract, T, p, q, n) }
+//最小値と最大値。NaNは無視する。NaN以外の要素がなければ{ NaN, NaN }を返す。
+template <class T>
+std::pair<T, T> SimdMinMax(const T* p, size_t n)
+{
+	T min = std::numeric_limits<T>::has_infinity ? std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+	T max = std::numeric_limits<T>::has_infinity ? -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+	[&]() { CUF_SIMD_DISPATCH(MinMax, T, p, n, min, max) }();
+	if constexpr (std::numeric_limits<T>::has_quiet_NaN)
+	{
+		//全て+inf、または全て-infの場合と区別するため、実際に要素を見つけたかどうかはmin <= maxで判定する。
+		if (!(min <= max)) return { std::numeric_limits<T>::quiet_NaN(), std::numeric_limits<T>::quiet_NaN() };
+	}
+	return { min, max };
+}
+//総和。floatもdoubleで累積する。
+template <class T>
+double SimdSum(const T* p, size_t n) { CUF_SIMD_DISPATCH(Sum, T, p, n) }
+//NaNと±infの個数。
+template <class T>
+size_t SimdCountNonFinite(const T* p, size_t n)
+{
+	if constexpr (!std::numeric_limits<T>::has_infinity && !std::numeric_limits<T>::has_quiet_NaN) return 0;
+	else { CUF_SIMD_DISPATCH(CountNonFinite, T, p, n) }
+}
+
+#undef CUF_SIMD_DISPATCH
+
+}
+
+}
+
+#endif
@@ -0,0 +1,263 @@
+#ifndef CUF_STATISTICS_H
+#define CUF_STATISTICS_H
+
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <ADAPT/CUF/Parallel.h>
+
+namespace adapt
+{
+
+inline namespace cuf
+{
+
+//箱ひげ図に必要な要約統計量。
+//四分位数は線形補間（Rのtype 7、Excelのquartile.incと同じ）で求める。
+//ひげは[q1 - k * IQR, q3 + k * IQR]に含まれる最も外側のデータ点まで伸ばし、その外側の点を外れ値とする。
+struct BoxSummary
+{
+	BoxSummary()
+		: mCount(0),
+		mMin(std::numeric_limits<double>::quiet_NaN()), mQ1(mMin), mMedian(mMin), mQ3(mMin), mMax(mMin),
+		mLowerWhisker(mMin), mUpperWhisker(mMin)
+	{}
+
+	size_t mCount;
+	double mMin;
+	double mQ1;
+	double mMedian;
+	double mQ3;
+	double mMax;
+	double mLowerWhisker;
+	double mUpperWhisker;
+	std::vector<double> mOutliers;
+};
+
+namespace detail
+{
+
+//[first, last)のk番目の値を選択する。[first, last)は並べ替えられる。
+//parallelがtrueならParallelNthElementを用いる。
+template <class RandomIt>
+double SelectOrderStatistic(RandomIt first, RandomIt last, size_t k, bool parallel)
+{
+	if (parallel) ParallelNthElement(first, first + k, last);
+	else std::nth_element(first, first + k, last);
+	return first[k];
+}
+
+}
+
+//dataの要約統計量を求める。dataは並べ替えられる。有限でない値は無視される。
+//whiskerはひげの長さを決めるIQRの倍数で、0以下ならひげは最小値、最大値まで伸び外れ値は生じない。
+//parallelがtrueなら、順序統計量の選択と外れ値の抽出を並列に行う。
+inline BoxSummary Summarize(std::vector<double>& data, double whisker = 1.5, bool parallel = false)
+{
+	BoxSummary s;
+	data.erase(std::remove_if(data.begin(), data.end(), [](double v) { return !std::isfinite(v); }), data.end());
+	size_t n = data.size();
+	s.mCount = n;
+	if (n == 0) return s;
+
+	//まず中央値の位置kmで分割し、以降の選択は互いに重ならない前半[0, km)と後半[km + 1, n)の中だけで行う。
+	auto first = data.begin();
+	auto last = data.end();
+	size_t km = (n - 1) / 2;
+	double vm = detail::SelectOrderStatistic(first, last, km, parallel);
+	double vm1 = km + 1 < n ? *std::min_element(first + km + 1, last) : vm;
+	//p分位点を、(n - 1)p番目の前後の値の線形補間で求める。
+	auto quantile = [&](double p) -> double
+	{
+		double h = (double)(n - 1) * p;
+		size_t k = (size_t)std::floor(h);
+		double frac = h - (double)k;
+		double v, next;
+		if (k < km)
+		{
+			v = detail::SelectOrderStatistic(first, first + km, k, parallel);
+			next = k + 1 < km ? *std::min_element(first + k + 1, first + km) : vm;
+		}
+		else if (k == km)
+		{
+			v = vm;
+			next = vm1;
+		}
+		else
+		{
+			v = detail::SelectOrderStatistic(first + km + 1, last, k - km - 1, parallel);
+			next = k + 1 < n ? *std::min_element(first + k + 1, last) : v;
+		}
+		return frac == 0. ? v : v + frac * (next - v);
+	};
+	s.mMedian = quantile(0.5);
+	s.mQ1 = quantile(0.25);
+	s.mQ3 = quantile(0.75);
+	s.mMin = km > 0 ? *std::min_element(first, first + km) : vm;
+	s.mMax = km + 1 < n ? *std::max_element(first + km + 1, last) : vm;
+
+	if (whisker <= 0.)
+	{
+		s.mLowerWhisker = s.mMin;
+		s.mUpperWhisker = s.mMax;
+		return s;
+	}
+	double iqr = s.mQ3 - s.mQ1;
+	double lofence = s.mQ1 - whisker * iqr;
+	double hifence = s.mQ3 + whisker * iqr;
+	//ひげの端と外れ値をスレッドごとに集めてから合わせる。
+	size_t nthreads = parallel ? GetNumThreads() : 1;
+	std::vector<double> lo(nthreads, std::numeric_limits<double>::infinity());
+	std::vector<double> hi(nthreads, -std::numeric_limits<double>::infinity());
+	std::vector<std::vector<double>> out(nthreads);
+	auto scan = [&](size_t b, size_t e, size_t t)
+	{
+		for (size_t i = b; i < e; ++i)
+		{
+			double v = data[i];
+			if (v < lofence || v > hifence) out[t].push_back(v);
+			else
+			{
+				lo[t] = std::min(lo[t], v);
+				hi[t] = std::max(hi[t], v);
+			}
+		}
+	};
+	if (parallel) ParallelFor(0, n, scan, 1 << 16);
+	else scan(0, n, 0);
+	s.mLowerWhisker = *std::min_element(lo.begin(), lo.end());
+	s.mUpperWhisker = *std::max_element(hi.begin(), hi.end());
+	for (auto& o : out) s.mOutliers.insert(s.mOutliers.end(), o.begin(), o.end());
+	std::sort(s.mOutliers.begin(), s.mOutliers.end());
+	return s;
+}
+
+//各グループの要約統計量を求める。グループ数がスレッド数より多ければグループ単位で並列に処理し、
+//そうでなければ各グループ内の処理を並列化する。groupsの各要素は並べ替えられる。
+inline std::vector<BoxSummary> Summarize(std::vector<std::vector<double>>& groups, double whisker = 1.5)
+{
+	std::vector<BoxSummary> res(groups.size());
+	if (groups.size() >= GetNumThreads())
+	{
+		ParallelFor(0, groups.size(), [&](size_t b, size_t e, size_t)
+		{
+			for (size_t i = b; i < e; ++i) res[i] = Summarize(groups[i], whisker, false);
+		}, 1);
+	}
+	else
+	{
+		for (size_t i = 0; i < groups.size(); ++i) res[i] = Summarize(groups[i], whisker, true);
+	}
+	return res;
+}
+
+//Welfordの方法で、個数、平均、分散、最小値、最大値を逐次的に求める。
+//別々に集計したもの同士をMergeで合わせられるので、スレッドごとに集計してから最後に合わせれば排他制御は要らない。
+class OnlineStatistics
+{
+public:
+
+	OnlineStatistics()
+		: mCount(0), mMean(0.), mM2(0.),
+		mMin(std::numeric_limits<double>::infinity()), mMax(-std::numeric_limits<double>::infinity())
+	{}
+
+	void Add(double v)
+	{
+		++mCount;
+		double d = v - mMean;
+		mMean += d / (double)mCount;
+		mM2 += d * (v - mMean);
+		mMin = std::min(mMin, v);
+		mMax = std::max(mMax, v);
+	}
+	//Chanらの方法で二つの集計結果を合わせる。
+	void Merge(const OnlineStatistics& o)
+	{
+		if (o.mCount == 0) return;
+		if (mCount == 0)
+		{
+			*this = o;
+			return;
+		}
+		size_t n = mCount + o.mCount;
+		double d = o.mMean - mMean;
+		mMean += d * (double)o.mCount / (double)n;
+		mM2 += o.mM2 + d * d * (double)mCount * (double)o.mCount / (double)n;
+		mCount = n;
+		mMin = std::min(mMin, o.mMin);
+		mMax = std::max(mMax, o.mMax);
+	}
+	OnlineStatistics& operator+=(const OnlineStatistics& o) { Merge(o); return *this; }
+
+	size_t GetCount() const { return mCount; }
+	//データがなければNaNを返す。
+	double GetMean() const { return mCount > 0 ? mMean : std::numeric_limits<double>::quiet_NaN(); }
+	//不偏分散。データが1個以下なら0を返す。
+	double GetVariance() const { return mCount > 1 ? mM2 / (double)(mCount - 1) : 0.; }
+	//標本分散。
+	double GetPopulationVariance() const { return mCount > 0 ? mM2 / (double)mCount : 0.; }
+	double GetStdDev() const { return std::sqrt(GetVariance()); }
+	double GetMin() const { return mMin; }
+	double GetMax() const { return mMax; }
+
+private:
+
+	size_t mCount;
+	double mMean;
+	double mM2;//平均からの偏差の二乗和。
+	double mMin;
+	double mMax;
+};
+
+inline void Merge(OnlineStatistics& to, const OnlineStatistics& from)
+{
+	to.Merge(from);
+}
+//時系列などの集計結果の配列を要素ごとに合わせる。
+template <class Accumulator>
+void Merge(std::vector<Accumulator>& to, const std::vector<Accumulator>& from)
+{
+	if (to.size() < from.size()) to.resize(from.size());
+	for (size_t i = 0; i < from.size(); ++i) Merge(to[i], from[i]);
+}
+
+//スレッドごとに独立した集計器を持ち、最後にReduceで合わせる。
+//各スレッドは自分の番号の集計器のみを更新するので排他制御は要らない。偽共有を避けるため集計器はキャッシュライン境界に置く。
+//ParallelForの第3引数のスレッド番号をそのまま使うことを想定している。
+template <class Accumulator>
+class PerThreadAccumulator
+{
+	struct alignas(64) Slot
+	{
+		Accumulator mValue;
+	};
+
+public:
+
+	explicit PerThreadAccumulator(size_t nthreads = adapt::GetNumThreads(), const Accumulator& init = Accumulator())
+		: mSlots(std::max<size_t>(nthreads, 1), Slot{ init })
+	{}
+
+	Accumulator& operator[](size_t thread) { return mSlots[thread].mValue; }
+	const Accumulator& operator[](size_t thread) const { return mSlots[thread].mValue; }
+	size_t GetNumSlots() const { return mSlots.size(); }
+
+	Accumulator Reduce() const
+	{
+		Accumulator res = mSlots.front().mValue;
+		for (size_t i = 1; i < mSlots.size(); ++i) Merge(res, mSlots[i].mValue);
+		return res;
+	}
+
+private:
+
+	std::vector<Slot> mSlots;
+};
+
+}
+
+}
+
+#endif
@@ -2,9 +2,13 @@
 #define GPM2_GPMARRAYDATA_H
 
 #include <ADAPT/CUF/Matrix.h>
+#include <ADAPT/CUF/MatrixView.h>
 #include <ADAPT/CUF/Variant.h>
 #include <vector>
 #include <string>
+#include <cstdint>
+#include <utility>
+#include <type_traits>
 
 namespace adapt
 {
@@ -12,14 +16,36 @@ namespace adapt
 namespace gpm2
 {
 
+namespace detail
+{
+
+//MatrixDataが受け付ける行列の要素の型。
+template <class T>
+struct IsMatrixDataElement
+	: std::integral_constant<bool, std::is_same<T, double>::value || std::is_same<T, float>::value ||
+									std::is_same<T, int8_t>::value || std::is_same<T, uint8_t>::value ||
+									std::is_same<T, int16_t>::value || std::is_same<T, uint16_t>::value ||
+									std::is_same<T, int32_t>::value || std::is_same<T, uint32_t>::value ||
+									std::is_same<T, int64_t>::value || std::is_same<T, uint64_t>::value>
+{};
+using NumericMatrixView = Variant<MatrixView<const double, 2>, MatrixView<const float, 2>,
+								  MatrixView<const int8_t, 2>, MatrixView<const uint8_t, 2>,
+								  MatrixView<const int16_t, 2>, MatrixView<const uint16_t, 2>,
+								  MatrixView<const int32_t, 2>, MatrixView<const uint32_t, 2>,
+								  MatrixView<const int64_t, 2>, MatrixView<const uint64_t, 2>>;
+
+}
+
 namespace plot
 {
 
 struct ArrayData
 {
-	enum Type { DBLVEC, STRVEC, COLUMN, UNIQUE, };
+	enum Type { DBLVEC, STRVEC, COLUMN, UNIQUE, DBLVIEW, };
 	ArrayData() {}
 	ArrayData(const std::vector<double>& vector) : mVariant(&vector) {}
+	ArrayData(const MatrixView<const double, 1>& view) : mVariant(view) {}
+	ArrayData(const MatrixView<double, 1>& view) : mVariant(MatrixView<const double, 1>(view)) {}
 	ArrayData(const std::vector<std::string>& strvec) : mVariant(&strvec) {}
 	ArrayData(const std::string& column) : mVariant(column) {}
 	ArrayData(const char* column) : mVariant(column) {}
@@ -31,36 +57,60 @@ struct ArrayData
 	const std::vector<std::string>& GetStrVec() const { return *mVariant.Get<STRVEC>(); }
 	const std::string& GetColumn() const { return mVariant.Get<COLUMN>(); }
 	double GetValue() const { return mVariant.Get<UNIQUE>(); }
+	//DBLVEC、DBLVIEWのいずれであっても、数値の配列をビューとして返す。
+	bool IsNumeric() const { return GetType() == DBLVEC || GetType() == DBLVIEW; }
+	MatrixView<const double, 1> GetView() const
+	{
+		if (GetType() == DBLVEC) return MatrixView<const double, 1>(GetVector());
+		return mVariant.Get<DBLVIEW>();
+	}
 
 	operator bool() const { return !IsEmpty(); }
 
 private:
 
-	Variant<const std::vector<double>*, const std::vector<std::string>*, std::string, double> mVariant;
+	Variant<const std::vector<double>*, const std::vector<std::string>*, std::string, double, MatrixView<const double, 1>> mVariant;
 };
 struct MatrixData
 {
-	enum Type { DBLMAT, COLUMN, UNIQUE, };
+	enum Type { DBLMAT, COLUMN, UNIQUE, NUMVIEW, };
 
 	MatrixData() {}
 	MatrixData(const Matrix<double>& matrix) : mVariant(&matrix) {}
+	//double以外の要素のMatrixは、与えた時点の大きさのビューとして保持する。
+	template <class T, std::enable_if_t<detail::IsMatrixDataElement<T>::value, std::nullptr_t> = nullptr>
+	MatrixData(const Matrix<T>& matrix) : mVariant(detail::NumericMatrixView(MatrixView<const T, 2>(matrix))) {}
+	template <class T, std::enable_if_t<detail::IsMatrixDataElement<std::remove_const_t<T>>::value, std::nullptr_t> = nullptr>
+	MatrixData(const MatrixView<T, 2>& view) : mVariant(detail::NumericMatrixView(MatrixView<const std::remove_const_t<T>, 2>(view))) {}
+	//MappedMatrixなど、GetView()で2次元のビューを返すもの。
+	template <class M, class View = std::decay_t<decltype(std::declval<const M&>().GetView())>,
+			  std::enable_if_t<View::GetDimension() == 2, std::nullptr_t> = nullptr>
+	MatrixData(const M& m) : MatrixData(m.GetView()) {}
 	MatrixData(const std::string& column) : mVariant(column) {}
 	MatrixData(const char* column) : mVariant(column) {}
 	MatrixData(double value) : mVariant(value) {}
 
 	bool IsEmpty() const { return mVariant.IsEmpty(); }
 	Type GetType() const { return (Type)mVariant.GetIndex(); }
-	const Matrix<double>& GetMatrix() const { return *mVariant.Get<0>(); }
-	const std::string& GetColumn() const { return mVariant.Get<1>(); }
-	double GetValue() const { return mVariant.Get<2>(); }
+	const Matrix<double>& GetMatrix() const { return *mVariant.Get<DBLMAT>(); }
+	const std::string& GetColumn() const { return mVariant.Get<COLUMN>(); }
+	double GetValue() const { return mVariant.Get<UNIQUE>(); }
+	//DBLMAT、NUMVIEWのいずれであっても、行列をMatrixView<const T, 2>としてf(view)に渡す。
+	//Tは与えられた要素の型のままなので、doubleの行列へコピーせずに書き出せる。
+	bool IsNumeric() const { return GetType() == DBLMAT || GetType() == NUMVIEW; }
+	template <class Func>
+	void VisitView(Func&& f) const
+	{
+		if (GetType() == DBLMAT) f(MatrixView<const double, 2>(GetMatrix()));
+		else mVariant.Get<NUMVIEW>().Visit(f);
+	}
 
 	operator bool() const { return !IsEmpty(); }
 
 private:
 
-	Variant<const Matrix<double>*, std::string, double> mVariant;
+	Variant<const Matrix<double>*, std::string, double, detail::NumericMatrixView> mVariant;
 };
-
 }
 
 }
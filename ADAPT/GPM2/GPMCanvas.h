@@ -6,11 +6,26 @@
 #include <vector>
 #include <string>
 #include <cfloat>
+#include <cmath>
+#include <numeric>
+#include <filesystem>
+#include <thread>
+#include <memory>
+#include <functional>
+#include <map>
 #include <ADAPT/CUF/Matrix.h>
+#include <ADAPT/CUF/MatrixView.h>
+#include <ADAPT/CUF/Resample.h>
 #include <ADAPT/CUF/KeywordArgs.h>
 #include <ADAPT/CUF/Format.h>
 #include <ADAPT/CUF/Function.h>
+#include <ADAPT/CUF/Statistics.h>
 #include <ADAPT/GPM2/GPMArrayData.h>
+#include <ADAPT/GPM2/GPMCommandSink.h>
+#include <ADAPT/GPM2/GPMStats.h>
+#include <ADAPT/GPM2/GPMTrace.h>
+#include <ADAPT/GPM2/GPMSmooth.h>
+#include <ADAPT/GPM2/GPMFit.h>
 
 namespace adapt
 {
@@ -31,6 +46,9 @@ public:
 	friend class GPMMultiPlot;
 
 	GPMCanvas(const std::string& output, double sizex = 0., double sizey = 0.);
+	// Send the commands to the given sink instead of the default one.
+	// The extension of output still selects the terminal. If the sink captures the image (GPMImageSink), no file is written.
+	GPMCanvas(const std::string& output, std::shared_ptr<GPMCommandSink> sink, double sizex = 0., double sizey = 0.);
 	GPMCanvas();
 	GPMCanvas(const GPMCanvas&) = delete;
 	GPMCanvas(GPMCanvas&&) = delete;
@@ -88,76 +106,178 @@ public:
 	void SetOutput(const std::string& output, double sizex, double sizey);
 	void Reset();
 	const std::string& GetOutput() const;
+	//出力画像のおおよその大きさをピクセル単位で返す。ベクター形式の場合は100dpi相当に換算する。
+	std::pair<int, int> GetResolution() const;
 
 	template <class ...Args>
 	void Command(Args&& ...args);
+	// Write already formatted text (e.g. rows of a datablock) to the command stream as it is.
+	void WriteData(const char* str, size_t size);
 	void ShowCommands(bool b);
 
+	// Performance counters of this canvas: bytes, rows and time of each Flush() and its series, and the spawn time.
+	GPMCanvasStats GetStats() const;
+	// Number of bytes this canvas has written to its sink.
+	size_t GetBytes() const;
+	// The callback is called with the final stats (including the time waiting for gnuplot to exit) when a canvas is destroyed.
+	using StatsCallback = std::function<void(const GPMCanvasStats&)>;
+	static void SetStatsCallback(StatsCallback callback);
+	//以下はGPMPlotBufferが統計を記録するために用いる。
+	void AddSeriesStats(GPMSeriesStats s);
+	void AddFlushStats(size_t commandbytes, double time);
+
+	//gnuplotの設定のうち、plotごとに既定値へ戻すもの（title、grid、size、範囲、logscaleなど）はC++側で管理する。
+	//SetTitleなどはkeyに対応するコマンドを記録するだけで、次のCommandの直前に、gnuplotに送ったものと異なるものだけを送る。
+	//ResetStateは各keyを既定値に戻す。毎フレーム同じ設定を繰り返す場合には、何も送られない。
+	void SetState(const std::string& key, const std::string& command);
+	void ResetState();
+	void ApplyState();
+
 	// Enable or disable datablock feature of Gnuplot
 	// If disabled, temporary files are created to pass data to Gnuplot.
 	void EnableInMemoryDataTransfer(bool b);
 	bool IsInMemoryDataTransferEnabled();
 
+	// Enable or disable skipping a datablock whose contents are the same as those last sent under the same name.
+	// Each datablock is then formatted in memory before being sent. Useful when a canvas plots many frames (GPMAnimation).
+	void EnableDataBlockReuse(bool b);
+	bool IsDataBlockReuseEnabled() const;
+	//以下はMakeDataObjectが用いる。内容のハッシュが前回送ったものと異なればtrueを返し、記録を更新する。
+	bool UpdateDataBlockHash(const std::string& name, uint64_t hash);
+
+	// Enable or disable computing smooth options (unique, frequency, cumulative, cnormal, csplines, acsplines,
+	// bezier, sbezier) in C++. If disabled, all samples are sent to Gnuplot and smoothed by Gnuplot itself.
+	// cumulative/cnormal curves are thinned to the output resolution only while every axis is linear and autoscaled.
+	void EnableNativeSmoothing(bool b);
+	bool IsNativeSmoothingEnabled() const;
+	// True if the next plot is known to use linear, autoscaled axes (no SetLog, SetRange or equivalent commands).
+	bool IsLinearAutoscale() const;
+
 	static void SetGnuplotPath(const std::string& path);
 	static std::string GetGnuplotPath();
 
+	// Record-and-replay mode.
+	// If a directory is given, canvases created afterwards write their whole command stream to "<dir>/<output>.gp"
+	// instead of piping it to gnuplot. The script and temporary data files of an absolute output are placed under <dir>
+	// with the root removed, and an output that would leave <dir> through ".." is rejected with InvalidArg.
+	// Relative paths in the scripts (output images, temporary data files) are relative to <dir>, so the directory
+	// can be rendered later by RenderScripts() on another machine.
+	// An empty string restores the default (live gnuplot).
+	static void SetScriptDirectory(const std::string& dir);
+	static const std::string& GetScriptDirectory();
+	bool IsScriptMode() const;
+	// Name by which the command stream refers to the data file "name" (relative to <dir> in script mode).
+	std::string GetDataFileName(const std::string& name) const;
+	// Path to which a data file referred to by the command stream should be written.
+	std::string GetDataFilePath(const std::string& name) const;
+	// Render every "*.gp" script under dir (recursively) with nprocesses gnuplot processes running in parallel.
+	// If nprocesses is 0, GetNumThreads() processes are used. Returns the number of scripts.
+	static size_t RenderScripts(const std::string& dir, size_t nprocesses = 0);
+
+	// Select where the command streams of canvases created afterwards go.
+	// The factory receives the output name and returns a sink (GPMPipeSink, GPMFileSink, GPMMemorySink, GPMNullSink or a user-defined one).
+	// An empty function restores the default: a GPMFileSink in script mode, otherwise a GPMPipeSink running GetGnuplotPath().
+	using SinkFactory = std::function<std::shared_ptr<GPMCommandSink>(const std::string& output)>;
+	static void SetSinkFactory(SinkFactory factory);
+	// Sink of this canvas. nullptr if it could not be opened.
+	GPMCommandSink* GetSink() const;
+
+	// Render cache. If enabled, canvases created afterwards with an image output (.png, .svg, .gif, .eps, .pdf) buffer
+	// their command stream and start gnuplot on destruction only if the stream or the data differ from
+	// the previous render of the same output (see GPMCachedSink). The default is disabled.
+	// A sink factory or script mode takes precedence over the cache.
+	static void EnableRenderCache(bool b);
+	static bool IsRenderCacheEnabled();
+
 protected:
 
+	//SetSinkFactoryやスクリプト記録モードの設定に従って出力先を開く。開けなければnullptrを返す。
+	static std::shared_ptr<GPMCommandSink> OpenSink(const std::string& output);
+	//SetOutputがファイルに書き出す端末を選ぶ拡張子かどうか。
+	static bool IsImageOutput(const std::string& output);
+
 	std::string mOutput;
-	FILE* mPipe;
+	std::shared_ptr<GPMCommandSink> mSink;
+	std::string mCommandBuffer;//Commandが書式化に使う作業領域。
+	GPMCanvasStats mStats;
+	size_t mInitialBytes;//multiplotで出力先を共有する場合に、このキャンバスより前に書き込まれたバイト数。
+	static std::string GetDefaultState(const std::string& key);
+	static std::string GetStateFamily(const std::string& key);
+	bool IsStateSent(const std::string& key, const std::string& command) const;
+	template <class Func>
+	static void ForEachCommand(const std::string& commands, Func f);
+	static std::vector<std::string> GetStateFamilies(const std::string& verb, const std::string& word);
+	static bool DependsOnState(const std::string& commands);
+	void InvalidateState(const std::string& commands);
+	static constexpr const char* msStateFamilies[] = { "autoscale", "logscale", "title", "grid", "size", "pm3d", "contour", "surface" };
+	std::map<std::string, std::string> mState;//次のplotで有効であるべき設定。
+	std::map<std::string, std::string> mSentState;//gnuplotに送った設定。ないものは不明。
+	bool mStateChanged;
 	bool mShowCommands;
 	bool mInMemoryDataTransfer; // Use datablock feature of Gnuplot if true (default: false)
+	bool mNativeSmoothing; // Compute smoothed curves in C++ if true (default: true)
+	bool mDataBlockReuse;
+	std::map<std::string, uint64_t> mDataBlockHashes;//送ったdatablockの内容のハッシュ。
+	int mResolutionX;
+	int mResolutionY;
 	template <class = void>
 	struct Paths
 	{
 		static std::string msGnuplotPath;
 		static const std::string msDefaultGnuplotPath;
-		static FILE* msGlobalPipe;//multiplotなどを利用する際のグローバルなパイプ。これがnullptrでない場合、mPipe==mGlobalPipeとなる。
+		static std::shared_ptr<GPMCommandSink> msGlobalSink;//multiplotなどを利用する際のグローバルな出力先。これがnullptrでない場合、mSink==msGlobalSinkとなる。
+		static SinkFactory msSinkFactory;
+		static StatsCallback msStatsCallback;
+		static std::string msScriptDirectory;//空でなければスクリプト記録モード。
+		static bool msRenderCache;
 	};
 };
 
 
 inline GPMCanvas::GPMCanvas(const std::string& output, double sizex, double sizey)
-	: mOutput(output), mPipe(nullptr), mShowCommands(false), mInMemoryDataTransfer(false)
+	: GPMCanvas(output, nullptr, sizex, sizey)
+{}
+inline GPMCanvas::GPMCanvas(const std::string& output, std::shared_ptr<GPMCommandSink> sink, double sizex, double sizey)
+	: mOutput(output), mInitialBytes(0), mStateChanged(false), mShowCommands(false), mInMemoryDataTransfer(false),
+	mNativeSmoothing(true), mDataBlockReuse(false), mResolutionX(800), mResolutionY(600)
 {
-	if (Paths<>::msGlobalPipe != nullptr) mPipe = Paths<>::msGlobalPipe;
+	if (sink != nullptr)
+	{
+		if (sink->IsOpen()) mSink = std::move(sink);
+		if (mSink) SetOutput(output, sizex, sizey);
+	}
+	else if (Paths<>::msGlobalSink != nullptr) mSink = Paths<>::msGlobalSink;
 	else
 	{
-#if defined(_WIN32)
-		if ((mPipe = _popen(GetGnuplotPath().c_str(), "w")) == nullptr)
-#elif defined(__linux__) || defined(__APPLE__)
-		if ((mPipe = popen(GetGnuplotPath().c_str(), "w")) == nullptr)
-#endif
-		{
-			std::cerr << "Gnuplot cannot open. " << GetGnuplotPath() << std::endl;
-		}
-		else
-		{
-			SetOutput(output, sizex, sizey);
-		}
+		auto t0 = std::chrono::steady_clock::now();
+		mSink = OpenSink(output);
+		mStats.mSpawnTime = detail::GetElapsedTime(t0);
+		if (mSink) SetOutput(output, sizex, sizey);
 	}
-	if (mPipe)
+	if (mSink) mInitialBytes = mSink->GetBytes();
+	//新しく起動したgnuplotの設定は既定値である。multiplotで共有する場合は前のキャンバスの設定が残っているかもしれない。
+	if (mSink && mSink != Paths<>::msGlobalSink) InvalidateState("reset");
+	if (mSink)
 	{
 		Command("set bars small");
 		Command("set palette defined ( 0 '#000090',1 '#000fff',2 '#0090ff',3 '#0fffee',4 '#90ff70',5 '#ffee00',6 '#ff7000',7 '#ee0000',8 '#7f0000')");
 	}
 }
 inline GPMCanvas::GPMCanvas()
-	: mOutput("ADAPT_GPM2_TMPFILE"), mPipe(nullptr), mShowCommands(false), mInMemoryDataTransfer(false)
+	: mOutput("ADAPT_GPM2_TMPFILE"), mInitialBytes(0), mStateChanged(false), mShowCommands(false), mInMemoryDataTransfer(false),
+	mNativeSmoothing(true), mDataBlockReuse(false), mResolutionX(800), mResolutionY(600)
 {
-	if (Paths<>::msGlobalPipe != nullptr) mPipe = Paths<>::msGlobalPipe;
+	if (Paths<>::msGlobalSink != nullptr) mSink = Paths<>::msGlobalSink;
 	else
 	{
-#if defined(_WIN32)
-		if ((mPipe = _popen(GetGnuplotPath().c_str(), "w")) == nullptr)
-#elif defined(__linux__) || defined(__APPLE__)
-		if ((mPipe = popen(GetGnuplotPath().c_str(), "w")) == nullptr)
-#endif
-		{
-			std::cerr << "Gnuplot cannot open. " << GetGnuplotPath() << std::endl;
-		}
+		auto t0 = std::chrono::steady_clock::now();
+		mSink = OpenSink(mOutput);
+		mStats.mSpawnTime = detail::GetElapsedTime(t0);
 	}
-	if (mPipe)
+	if (mSink) mInitialBytes = mSink->GetBytes();
+	//新しく起動したgnuplotの設定は既定値である。multiplotで共有する場合は前のキャンバスの設定が残っているかもしれない。
+	if (mSink && mSink != Paths<>::msGlobalSink) InvalidateState("reset");
+	if (mSink)
 	{
 		Command("set bars small");
 		Command("set palette defined ( 0 '#000090',1 '#000fff',2 '#0090ff',3 '#0fffee',4 '#90ff70',5 '#ffee00',6 '#ff7000',7 '#ee0000',8 '#7f0000')");
@@ -165,16 +285,46 @@ inline GPMCanvas::GPMCanvas()
 }
 inline GPMCanvas::~GPMCanvas()
 {
-	if (mPipe != nullptr && mPipe != Paths<>::msGlobalPipe)
+	//パイプの場合はGPMPipeSinkのデストラクタがexitを送って閉じる。multiplot中のグローバルな出力先は閉じない。
+	//出力先を共有する次のキャンバスのために、既定値に戻した設定を送っておく。
+	if (mSink && mSink == Paths<>::msGlobalSink && mStateChanged) ApplyState();
+	GPMCanvasStats stats;
+	if (Paths<>::msStatsCallback) stats = GetStats();
+	auto t0 = std::chrono::steady_clock::now();
 	{
-		Command("exit");
-#if defined(_WIN32)
-		_pclose(mPipe);
-#elif defined(__linux__) || defined(__APPLE__)
-		pclose(mPipe);
-#endif
+		detail::TraceScope trace("WaitGnuplot", mOutput);
+		mSink = nullptr;
+	}
+	stats.mWaitTime = detail::GetElapsedTime(t0);
+	if (Paths<>::msStatsCallback) Paths<>::msStatsCallback(stats);
+}
+inline std::shared_ptr<GPMCommandSink> GPMCanvas::OpenSink(const std::string& output)
+{
+	detail::TraceScope trace("OpenSink", output);
+	std::shared_ptr<GPMCommandSink> sink;
+	if (Paths<>::msSinkFactory) sink = Paths<>::msSinkFactory(output);
+	else if (!Paths<>::msScriptDirectory.empty())
+	{
+		//絶対パスのoutputを/で繋ぐとディレクトリが無視されるので、ルートを除いた相対パスとしてディレクトリの下に置く。
+		//".."でディレクトリの外に出るものは受け付けない。
+		std::filesystem::path rel = (std::filesystem::path(output + ".gp")).relative_path().lexically_normal();
+		if (rel.empty() || *rel.begin() == "..")
+			throw InvalidArg("output \"" + output + "\" cannot be placed under the script directory.");
+		std::filesystem::path path = std::filesystem::path(Paths<>::msScriptDirectory) / rel;
+		sink = std::make_shared<GPMFileSink>(path.string(), Paths<>::msScriptDirectory);
 	}
-	mPipe = nullptr;
+	else if (Paths<>::msRenderCache && IsImageOutput(output))
+		sink = std::make_shared<GPMCachedSink>(output, GetGnuplotPath());
+	else sink = std::make_shared<GPMPipeSink>(GetGnuplotPath());
+	if (sink && !sink->IsOpen()) sink = nullptr;
+	return sink;
+}
+
+inline bool GPMCanvas::IsImageOutput(const std::string& output)
+{
+	if (output.size() <= 4) return false;
+	std::string extension = output.substr(output.size() - 4, 4);
+	return extension == ".png" || extension == ".svg" || extension == ".gif" || extension == ".eps" || extension == ".pdf";
 }
 
 inline void GPMCanvas::SetLabel(const std::string& axis, const std::string& label)
@@ -183,20 +333,20 @@ inline void GPMCanvas::SetLabel(const std::string& axis, const std::string& labe
 }
 inline void GPMCanvas::SetRange(const std::string& axis, double min, double max)
 {
-	Command(Format("set %srange [%lf:%lf]", axis, min, max));
+	SetState(axis + "range", Format("set %srange [%lf:%lf]", axis, min, max));
 }
 inline void GPMCanvas::SetRangeMin(const std::string& axis, double min)
 {
-	Command(Format("set %srange [%lf:]", axis, min));
+	SetState(axis + "range", Format("set %srange [%lf:]", axis, min));
 }
 inline void GPMCanvas::SetRangeMax(const std::string& axis, double max)
 {
-	Command(Format("set %srange [:%lf]", axis, max));
+	SetState(axis + "range", Format("set %srange [:%lf]", axis, max));
 }
 
 inline void GPMCanvas::SetLog(const std::string& axis, double base)
 {
-	Command(Format("set logscale %s %lf", axis, base));
+	SetState("logscale " + axis, Format("set logscale %s %lf", axis, base));
 }
 
 inline void GPMCanvas::SetTics_make(std::string& tics)
@@ -216,16 +366,16 @@ inline void GPMCanvas::SetGrid(const std::string& color, int type, int width)
 	if (!color.empty()) c += " linecolor rgb \"" + color + "\"";
 	if (type != -2) c += " linetype " + std::to_string(type);
 	if (width != -1) c += " linewidth " + std::to_string(width);
-	Command("set grid" + c);
+	SetState("grid", "set grid" + c);
 }
 
 inline void GPMCanvas::SetSize(double x, double y)
 {
-	Command(Format("set size %lf, %lf", x, y));
+	SetState("size", Format("set size %lf, %lf", x, y));
 }
 inline void GPMCanvas::SetSizeRatio(double ratio)
 {
-	Command(Format("set size ratio %lf", ratio));
+	SetState("size", Format("set size ratio %lf", ratio));
 }
 inline void GPMCanvas::SetPaletteDefined(const std::vector<std::pair<double, std::string>>& color)
 {
@@ -251,7 +401,7 @@ inline void GPMCanvas::SetPaletteMaxcolors(int num)
 }
 inline void GPMCanvas::SetTitle(const std::string& title)
 {
-	Command("set title '" + title + "'");
+	SetState("title", "set title '" + title + "'");
 }
 inline void GPMCanvas::SetParametric()
 {
@@ -289,20 +439,37 @@ inline void GPMCanvas::SetOutput(const std::string& output, double sizex, double
 	{
 		std::string extension = output.substr(output.size() - 4, 4);
 		std::string repout = ReplaceStr(output, "\\", "/");
+		//画像を取り込む出力先の場合は、ファイル名を与えずgnuplotの標準出力に書かせる。
+		std::string setoutput = mSink && mSink->CapturesImage() ? "\nset output" : "\nset output '" + repout + "'";
 		if (extension == ".png")
 		{
 			if (sizex == 0 && sizey == 0) sizex = 800, sizey = 600;
-			Command(Format("set terminal pngcairo enhanced size %d, %d\nset output '" + repout + "'", sizex, sizey));
+			Command(Format("set terminal pngcairo enhanced size %d, %d", sizex, sizey) + setoutput);
+			mResolutionX = (int)sizex, mResolutionY = (int)sizey;
+		}
+		else if (extension == ".svg")
+		{
+			if (sizex == 0 && sizey == 0) sizex = 800, sizey = 600;
+			Command(Format("set terminal svg enhanced size %d, %d", sizex, sizey) + setoutput);
+			mResolutionX = (int)sizex, mResolutionY = (int)sizey;
+		}
+		else if (extension == ".gif")
+		{
+			if (sizex == 0 && sizey == 0) sizex = 800, sizey = 600;
+			Command(Format("set terminal gif enhanced size %d, %d", sizex, sizey) + setoutput);
+			mResolutionX = (int)sizex, mResolutionY = (int)sizey;
 		}
 		else if (extension == ".eps")
 		{
 			if (sizex == 0 && sizey == 0) sizex = 6, sizey = 4.5;
-			Command(Format("set terminal epscairo enhanced size %din, %din\nset output '" + repout + "'", sizex, sizey));
+			Command(Format("set terminal epscairo enhanced size %din, %din", sizex, sizey) + setoutput);
+			mResolutionX = (int)(sizex * 100), mResolutionY = (int)(sizey * 100);
 		}
 		else if (extension == ".pdf")
 		{
 			if (sizex == 0 && sizey == 0) sizex = 6, sizey = 4.5;
-			Command(Format("set terminal pdfcairo enhanced size %lfin, %lfin\nset output '" + repout + "'", sizex, sizey));
+			Command(Format("set terminal pdfcairo enhanced size %lfin, %lfin", sizex, sizey) + setoutput);
+			mResolutionX = (int)(sizex * 100), mResolutionY = (int)(sizey * 100);
 		}
 	}
 	else if (output == "wxt");
@@ -317,12 +484,211 @@ inline const std::string& GPMCanvas::GetOutput() const
 {
 	return mOutput;
 }
+inline std::pair<int, int> GPMCanvas::GetResolution() const
+{
+	return { mResolutionX, mResolutionY };
+}
 
 template <class ...Args>
 inline void GPMCanvas::Command(Args&& ...args)
 {
-	adapt::Print(mPipe, std::forward<Args>(args)...);
-	if (mShowCommands) adapt::Print(std::cout, std::forward<Args>(args)...);
+	if (!mSink) return;
+	mCommandBuffer.clear();
+	adapt::Print(mCommandBuffer, std::forward<Args>(args)...);
+	if (mStateChanged && DependsOnState(mCommandBuffer)) ApplyState();
+	InvalidateState(mCommandBuffer);
+	mSink->Write(mCommandBuffer);
+	if (mShowCommands) std::cout << mCommandBuffer;
+}
+inline std::string GPMCanvas::GetDefaultState(const std::string& key)
+{
+	//gnuplotの起動直後の状態で、plotごとにここへ戻す。
+	if (key == "autoscale") return "set autoscale";
+	if (key == "logscale") return "unset logscale";
+	if (key == "size") return "set size noratio";
+	if (key == "surface") return "set surface";
+	if (key.compare(0, 9, "logscale ") == 0) return "unset " + key;
+	if (key.size() > 5 && key.compare(key.size() - 5, 5, "range") == 0) return "set autoscale " + key.substr(0, key.size() - 5);
+	return "unset " + key;//title, grid, pm3d, contour
+}
+inline std::string GPMCanvas::GetStateFamily(const std::string& key)
+{
+	//軸ごとのkeyは、全軸をまとめて戻すkeyに属する。
+	if (key.compare(0, 9, "logscale ") == 0) return "logscale";
+	if (key.size() > 5 && key.compare(key.size() - 5, 5, "range") == 0) return "autoscale";
+	return key;
+}
+inline bool GPMCanvas::IsStateSent(const std::string& key, const std::string& command) const
+{
+	auto it = mSentState.find(key);
+	if (it != mSentState.end()) return it->second == command;
+	//軸ごとの設定は、その族全体が既定値なら既定値である。
+	std::string family = GetStateFamily(key);
+	if (family == key || command != GetDefaultState(key)) return false;
+	it = mSentState.find(family);
+	return it != mSentState.end() && it->second == GetDefaultState(family);
+}
+inline void GPMCanvas::SetState(const std::string& key, const std::string& command)
+{
+	//既定値から変更された後に同じkeyを設定した場合は、gnuplotと同様に積み重ねる（SetRangeMinとSetRangeMaxなど）。
+	auto it = mState.find(key);
+	if (it == mState.end() || it->second == GetDefaultState(key)) mState[key] = command;
+	else it->second += "\n" + command;
+	mStateChanged = true;
+}
+inline void GPMCanvas::ResetState()
+{
+	for (const char* key : msStateFamilies) mState[key] = GetDefaultState(key);
+	for (auto& s : mState) s.second = GetDefaultState(s.first);
+	for (auto& s : mSentState) mState[s.first] = GetDefaultState(s.first);
+	mStateChanged = true;
+}
+inline void GPMCanvas::ApplyState()
+{
+	mStateChanged = false;
+	if (!mSink) return;
+	std::string c;
+	//既定値に戻すものを先に送る。"unset logscale xy"の後に"set logscale x"を送るような場合があるため。
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		for (auto& s : mState)
+		{
+			std::string def = GetDefaultState(s.first);
+			if ((s.second == def) != (pass == 0)) continue;
+			if (IsStateSent(s.first, s.second)) continue;
+			c += s.second + "\n";
+			if (GetStateFamily(s.first) == s.first)
+			{
+				//族全体を戻した場合、軸ごとの設定も既定値になる。
+				for (auto it = mSentState.begin(); it != mSentState.end();)
+				{
+					if (it->first != s.first && GetStateFamily(it->first) == s.first) it = mSentState.erase(it);
+					else ++it;
+				}
+			}
+			mSentState[s.first] = s.second;
+		}
+	}
+	if (c.empty()) return;
+	mSink->Write(c);
+	if (mShowCommands) std::cout << c;
+}
+template <class Func>
+inline void GPMCanvas::ForEachCommand(const std::string& commands, Func f)
+{
+	//行または;で区切られた各コマンドの、最初の語（set、plotなど）と次の語をfに渡す。
+	size_t pos = 0;
+	while (pos < commands.size())
+	{
+		size_t end = commands.find_first_of("\n;", pos);
+		if (end == std::string::npos) end = commands.size();
+		size_t b = commands.find_first_not_of(" \t", pos);
+		pos = end + 1;
+		if (b == std::string::npos || b >= end) continue;
+		size_t e = std::min(commands.find_first_of(" \t", b), end);
+		std::string verb = commands.substr(b, e - b);
+		std::string word;
+		b = commands.find_first_not_of(" \t", e);
+		if (b != std::string::npos && b < end)
+		{
+			e = std::min(commands.find_first_of(" \t", b), end);
+			word = commands.substr(b, e - b);
+		}
+		f(verb, word);
+	}
+}
+inline std::vector<std::string> GPMCanvas::GetStateFamilies(const std::string& verb, const std::string& word)
+{
+	//set/unsetの対象が管理している設定に触れうるなら、その族を返す。
+	//gnuplotの省略形（"set tit"など）も考慮し、判別できない場合は触れうるものとして扱う。
+	std::vector<std::string> res;
+	if (verb != "set" && verb != "unset") return res;
+	auto is_prefix = [&word](const std::string& name)
+	{
+		return !word.empty() && name.compare(0, word.size(), word) == 0;
+	};
+	for (const char* family : msStateFamilies)
+		if (is_prefix(family)) res.push_back(family);
+	for (std::string axis : { "x", "y", "z", "x2", "y2", "cb", "r", "t", "u", "v" })
+	{
+		if (word.size() > axis.size() && is_prefix(axis + "range"))
+		{
+			res.push_back("autoscale");
+			break;
+		}
+	}
+	return res;
+}
+inline bool GPMCanvas::DependsOnState(const std::string& commands)
+{
+	//管理していない設定（set outputなど）を変えるだけのコマンドは、保留中の設定より先に送ってよい。
+	bool res = false;
+	ForEachCommand(commands, [&res](const std::string& verb, const std::string& word)
+	{
+		if ((verb != "set" && verb != "unset") || !GetStateFamilies(verb, word).empty()) res = true;
+	});
+	return res;
+}
+inline void GPMCanvas::InvalidateState(const std::string& commands)
+{
+	//CommandやSetLabelなどで直接送られたコマンドのうち、管理している設定に触れうるものを不明として扱う。
+	auto forget = [this](const std::string& family)
+	{
+		for (auto it = mSentState.begin(); it != mSentState.end();)
+		{
+			if (GetStateFamily(it->first) == family) it = mSentState.erase(it);
+			else ++it;
+		}
+		for (auto it = mState.begin(); it != mState.end();)
+		{
+			if (GetStateFamily(it->first) == family) it = mState.erase(it);
+			else ++it;
+		}
+	};
+	ForEachCommand(commands, [this, &forget](const std::string& verb, const std::string& word)
+	{
+		if (verb == "reset")
+		{
+			mState.clear();
+			mSentState.clear();
+			for (const char* key : msStateFamilies) mSentState[key] = GetDefaultState(key);
+			return;
+		}
+		for (auto& family : GetStateFamilies(verb, word)) forget(family);
+	});
+}
+inline void GPMCanvas::WriteData(const char* str, size_t size)
+{
+	if (!mSink) return;
+	mSink->Write(str, size);
+	if (mShowCommands) std::cout.write(str, size);
+}
+inline GPMCanvasStats GPMCanvas::GetStats() const
+{
+	GPMCanvasStats res = mStats;
+	res.mBytes = GetBytes();
+	return res;
+}
+inline size_t GPMCanvas::GetBytes() const
+{
+	return mSink ? mSink->GetBytes() - mInitialBytes : 0;
+}
+inline void GPMCanvas::SetStatsCallback(StatsCallback callback)
+{
+	Paths<>::msStatsCallback = std::move(callback);
+}
+inline void GPMCanvas::AddSeriesStats(GPMSeriesStats s)
+{
+	mStats.mPending.mSeries.push_back(std::move(s));
+}
+inline void GPMCanvas::AddFlushStats(size_t commandbytes, double time)
+{
+	mStats.mPending.mCommandBytes = commandbytes;
+	mStats.mPending.mFlushTime = time;
+	mStats.mTotal.Add(mStats.mPending);
+	if (mStats.mFlushes.size() >= GPMCanvasStats::msMaxRecentFlushes) mStats.mFlushes.erase(mStats.mFlushes.begin());
+	mStats.mFlushes.push_back(std::move(mStats.mPending));
+	mStats.mPending = GPMFlushStats();
 }
 inline void GPMCanvas::ShowCommands(bool b)
 {
@@ -339,6 +705,49 @@ inline bool GPMCanvas::IsInMemoryDataTransferEnabled()
 	return mInMemoryDataTransfer;
 }
 
+inline void GPMCanvas::EnableDataBlockReuse(bool b)
+{
+	mDataBlockReuse = b;
+	if (!b) mDataBlockHashes.clear();
+}
+inline bool GPMCanvas::IsDataBlockReuseEnabled() const
+{
+	return mDataBlockReuse;
+}
+inline bool GPMCanvas::UpdateDataBlockHash(const std::string& name, uint64_t hash)
+{
+	auto res = mDataBlockHashes.emplace(name, hash);
+	if (res.second) return true;
+	if (res.first->second == hash) return false;
+	res.first->second = hash;
+	return true;
+}
+inline void GPMCanvas::EnableNativeSmoothing(bool b)
+{
+	mNativeSmoothing = b;
+}
+
+inline bool GPMCanvas::IsNativeSmoothingEnabled() const
+{
+	return mNativeSmoothing;
+}
+inline bool GPMCanvas::IsLinearAutoscale() const
+{
+	//logscale、autoscaleの族に属する設定が、次のplotの時点ですべて既定値であると分かっているか。不明な場合はfalse。
+	auto is_default = [this](const std::string& family)
+	{
+		for (auto& s : mState)
+			if (GetStateFamily(s.first) == family && s.second != GetDefaultState(s.first)) return false;
+		if (mState.count(family)) return true;
+		auto it = mSentState.find(family);
+		if (it == mSentState.end() || it->second != GetDefaultState(family)) return false;
+		for (auto& s : mSentState)
+			if (GetStateFamily(s.first) == family && !mState.count(s.first) && s.second != GetDefaultState(s.first)) return false;
+		return true;
+	};
+	return is_default("logscale") && is_default("autoscale");
+}
+
 inline void GPMCanvas::SetGnuplotPath(const std::string& path)
 {
 	Paths<>::msGnuplotPath = path;
@@ -359,7 +768,91 @@ template <class T>
 const std::string GPMCanvas::Paths<T>::msDefaultGnuplotPath = "gnuplot";
 #endif
 template <class T>
-FILE* GPMCanvas::Paths<T>::msGlobalPipe = nullptr;
+std::shared_ptr<GPMCommandSink> GPMCanvas::Paths<T>::msGlobalSink = nullptr;
+template <class T>
+GPMCanvas::SinkFactory GPMCanvas::Paths<T>::msSinkFactory = nullptr;
+template <class T>
+GPMCanvas::StatsCallback GPMCanvas::Paths<T>::msStatsCallback = nullptr;
+template <class T>
+std::string GPMCanvas::Paths<T>::msScriptDirectory = "";
+template <class T>
+bool GPMCanvas::Paths<T>::msRenderCache = false;
+
+inline void GPMCanvas::SetScriptDirectory(const std::string& dir)
+{
+	Paths<>::msScriptDirectory = dir;
+}
+inline const std::string& GPMCanvas::GetScriptDirectory()
+{
+	return Paths<>::msScriptDirectory;
+}
+inline void GPMCanvas::SetSinkFactory(SinkFactory factory)
+{
+	Paths<>::msSinkFactory = std::move(factory);
+}
+inline GPMCommandSink* GPMCanvas::GetSink() const
+{
+	return mSink.get();
+}
+inline void GPMCanvas::EnableRenderCache(bool b)
+{
+	Paths<>::msRenderCache = b;
+}
+inline bool GPMCanvas::IsRenderCacheEnabled()
+{
+	return Paths<>::msRenderCache;
+}
+inline bool GPMCanvas::IsScriptMode() const
+{
+	return mSink && mSink->IsScript();
+}
+inline std::string GPMCanvas::GetDataFileName(const std::string& name) const
+{
+	return mSink ? mSink->GetDataFileName(name) : name;
+}
+inline std::string GPMCanvas::GetDataFilePath(const std::string& name) const
+{
+	return mSink ? mSink->GetDataFilePath(name) : name;
+}
+inline size_t GPMCanvas::RenderScripts(const std::string& dir, size_t nprocesses)
+{
+	namespace fs = std::filesystem;
+	if (!fs::is_directory(dir)) throw InvalidArg("directory \"" + dir + "\" does not exist.");
+	std::vector<std::string> scripts;
+	for (auto& e : fs::recursive_directory_iterator(dir))
+	{
+		if (e.is_regular_file() && e.path().extension() == ".gp")
+			scripts.push_back(e.path().lexically_relative(dir).generic_string());
+	}
+	std::sort(scripts.begin(), scripts.end());
+	if (scripts.empty()) return 0;
+	if (nprocesses == 0) nprocesses = GetNumThreads();
+	nprocesses = std::min(nprocesses, scripts.size());
+
+	//gnuplotの文字列中の'は''と書く。
+	auto quote = [](const std::string& str) { return "'" + ReplaceStr(ReplaceStr(str, "\\", "/"), "'", "''") + "'"; };
+	//全てのプロセスを先に起動し、スクリプトを順に割り振ってから終了を待つ。
+	//各プロセスは受け取ったスクリプトを逐次処理するので、プロセス間では並列に描画される。
+	std::vector<std::unique_ptr<GPMPipeSink>> pipes;
+	for (size_t i = 0; i < nprocesses; ++i)
+	{
+		auto p = std::make_unique<GPMPipeSink>(GetGnuplotPath());
+		if (!p->IsOpen()) continue;
+		p->Write("cd " + quote(fs::absolute(dir).generic_string()) + "\n");
+		pipes.push_back(std::move(p));
+	}
+	if (pipes.empty()) throw NotInitialized("gnuplot cannot be opened.");
+	for (size_t i = 0; i < scripts.size(); ++i)
+	{
+		//前のスクリプトの設定や出力先が次のスクリプトに残らないようにする。
+		pipes[i % pipes.size()]->Write("load " + quote(scripts[i]) + "\nunset output\nreset\n");
+	}
+	for (auto& p : pipes) p->Flush();
+	//GPMPipeSinkのデストラクタがexitを送り、各プロセスの終了を待つ。
+	detail::TraceScope trace("WaitGnuplot", dir);
+	pipes.clear();
+	return scripts.size();
+}
 
 template <class ...Args>
 inline void GPMCanvas::SetTics(const std::string& axis, Args&& ...args)
@@ -385,13 +878,15 @@ inline void GPMCanvas::SetTics_make(std::string& tics, const std::string& label,
 namespace detail
 {
 
-using DataIterator = Variant<std::vector<double>::const_iterator, std::vector<std::string>::const_iterator>;
+using DataIterator = Variant<std::vector<double>::const_iterator, std::vector<std::string>::const_iterator, MatrixView<const double, 1>::Iterator>;
 
+//MakeDataObjectCommonはいずれも、書き出した点の数（空行を除く行数）を返す。
 template <class OutputFunc>
-inline void MakeDataObjectCommon(OutputFunc output_func, std::vector<DataIterator>& its, size_t size)
+inline size_t MakeDataObjectCommon(OutputFunc output_func, std::vector<DataIterator>& its, size_t size)
 {
 	auto f = Overload([](std::vector<double>::const_iterator& it, auto output_func) { output_func(" ", *it, print::end<'\0'>()); ++it; },
-		[](std::vector<std::string>::const_iterator& it, auto output_func) { output_func(" ", it->c_str(), print::end<'\0'>()); ++it; });
+		[](std::vector<std::string>::const_iterator& it, auto output_func) { output_func(" ", it->c_str(), print::end<'\0'>()); ++it; },
+		[](MatrixView<const double, 1>::Iterator& it, auto output_func) { output_func(" ", *it, print::end<'\0'>()); ++it; });
 
 	for (size_t i = 0; i < size; ++i)
 	{
@@ -401,10 +896,19 @@ inline void MakeDataObjectCommon(OutputFunc output_func, std::vector<DataIterato
 		}
 		output_func("\n", print::end<>());
 	}
+	return size;
 }
 
-template <class OutputFunc, class GetX, class GetY>
-inline void MakeDataObjectCommon(OutputFunc output_func, const Matrix<double>& map, GetX getx, GetY gety)
+//行列の要素を書き出す際の型。浮動小数点数はdoubleとして、整数は値を丸めないよう64bitの整数として書き出す。
+template <class T>
+inline auto ToOutputValue(T v)
+{
+	if constexpr (std::is_floating_point<T>::value) return (double)v;
+	else if constexpr (std::is_signed<T>::value) return (long long)v;
+	else return (unsigned long long)v;
+}
+template <class OutputFunc, class T, class GetX, class GetY>
+inline size_t MakeDataObjectCommon(OutputFunc output_func, const MatrixView<T, 2>& map, GetX getx, GetY gety)
 {
 	uint32_t xsize = map.GetSize(0);
 	uint32_t ysize = map.GetSize(1);
@@ -419,7 +923,7 @@ inline void MakeDataObjectCommon(OutputFunc output_func, const Matrix<double>& m
 			double cx = getx.center(ix);
 			//output_func(std::to_string(x) + " " + std::to_string(y) + " " + std::to_string(cx)
 			//			+ " " + std::to_string(cy) + " " + std::to_string(map[ix][iy]));
-			output_func(x, y, cx, cy, map[ix][iy]);
+			output_func(x, y, cx, cy, ToOutputValue(map(ix, iy)));
 		}
 		double x = getx(xsize);
 		double cx = getx.center(xsize);
@@ -440,44 +944,193 @@ inline void MakeDataObjectCommon(OutputFunc output_func, const Matrix<double>& m
 	//output_func(std::to_string(getx(xsize)) + " " + std::to_string(y) + " " + std::to_string(getx.center(xsize))
 	//			+ " " + std::to_string(cy) + " 0");
 	output_func(getx(xsize), y, getx.center(xsize), cy, " 0");
+	return (size_t)(xsize + 1) * (ysize + 1);
 }
-struct OutputFunc1
+//skip_valueで指定された、書き出さないセルの値。
+struct SkipValue
 {
+	template <class T>
+	bool operator()(T v) const
+	{
+		return std::isnan(mValue) ? std::isnan((double)v) : (double)v == mValue;
+	}
+	double mValue;
+};
+//四角形の4つの頂点を、2点ずつの2本の走査線として書き出す。四角形の間は2行空けて別の面とする。
+template <class OutputFunc, class V>
+inline void MakeColormapQuad(OutputFunc& output_func, double x0, double x1, double y0, double y1, double cx, double cy, V v)
+{
+	output_func(x0, y0, cx, cy, v);
+	output_func(x1, y0, cx, cy, v);
+	output_func("\n", print::end<>());
+	output_func(x0, y1, cx, cy, v);
+	output_func(x1, y1, cx, cy, v);
+	output_func("\n\n", print::end<>());
+}
+//mapのうちskipに該当しないセルのみを、それぞれ独立した四角形として書き出す。
+//空のセルを塗る背景は、ColormapBackgroundとして別のデータに書き出し、plotコマンドでこれより先に描く。
+template <class OutputFunc, class T, class GetX, class GetY>
+inline size_t MakeDataObjectCommon(OutputFunc output_func, const MatrixView<T, 2>& map, GetX getx, GetY gety, SkipValue skip)
+{
+	uint32_t xsize = map.GetSize(0);
+	uint32_t ysize = map.GetSize(1);
+	size_t cells = 0;
+	//mapはyの方向に連続しているので、xを外側に回す。
+	for (uint32_t ix = 0; ix < xsize; ++ix)
+	{
+		double x0 = getx(ix);
+		double x1 = getx(ix + 1);
+		double cx = getx.center(ix);
+		for (uint32_t iy = 0; iy < ysize; ++iy)
+		{
+			T v = map(ix, iy);
+			if (skip(v)) continue;
+			MakeColormapQuad(output_func, x0, x1, gety(iy), gety(iy + 1), cx, gety.center(iy), ToOutputValue(v));
+			++cells;
+		}
+	}
+	return cells * 4;
+}
+//skip_valueを与えたカラーマップの、全体を覆う背景。
+struct ColormapBackground
+{
+	double mX0, mX1, mY0, mY1;
+	double mCX, mCY;
+	double mValue;
+};
+template <class OutputFunc>
+inline size_t MakeDataObjectCommon(OutputFunc output_func, const ColormapBackground& bg)
+{
+	MakeColormapQuad(output_func, bg.mX0, bg.mX1, bg.mY0, bg.mY1, bg.mCX, bg.mCY, bg.mValue);
+	return 4;
+}
+//背景のdatablock名またはファイル名。等高線の"_cntr"、"cntr.txt"と同様に、グラフの名前から作る。
+inline std::string GetColormapBackgroundName(const std::string& graph, bool inmemory)
+{
+	if (inmemory) return graph + "_bg";
+	return graph.substr(0, graph.size() - 3) + "bg.txt";
+}
+//書式化したデータを一定の大きさごとにまとめて、キャンバスの出力先かファイルに書き出す。
+//まとめて書き出す時間をI/O時間として計る。
+//数値の書式は従来通り、datablockではPrint(FILE*)と同じ固定小数点、ファイルではstd::ostreamの既定の書式とする。
+class DataWriter
+{
+public:
+
+	//holdがtrueの場合は、Writeが呼ばれるまで全体をGetBufferで参照できる形で保持する。
+	DataWriter(GPMCanvas* g, FILE* fp, bool hold = false)
+		: mCanvas(g), mFile(fp), mHold(hold), mBytes(0), mIOTime(0.)
+	{
+		mBuffer.reserve(msChunkSize + 256);
+	}
+
 	template <class ...Args>
-	void operator()(Args&& ...args) const
+	void Append(Args&& ...args)
 	{
-		g->Command(std::forward<Args>(args)...);
+		if (mFile != nullptr)
+		{
+			Print(mStream, std::forward<Args>(args)...);
+			if ((size_t)mStream.tellp() >= msChunkSize) Write();
+		}
+		else
+		{
+			Print(mBuffer, std::forward<Args>(args)...);
+			if (!mHold && mBuffer.size() >= msChunkSize) Write();
+		}
 	}
-	GPMCanvas* g;
+	void Write()
+	{
+		if (mFile != nullptr)
+		{
+			mBuffer = mStream.str();
+			mStream.str("");
+		}
+		if (mBuffer.empty()) return;
+		TraceScope trace("Write");
+		auto t0 = std::chrono::steady_clock::now();
+		if (mFile != nullptr)
+		{
+			fwrite(mBuffer.data(), 1, mBuffer.size(), mFile);
+			if (GPMCommandSink* sink = mCanvas->GetSink()) sink->AddFileData(mBuffer.data(), mBuffer.size());
+		}
+		else mCanvas->WriteData(mBuffer.data(), mBuffer.size());
+		mIOTime += GetElapsedTime(t0);
+		mBytes += mBuffer.size();
+		mBuffer.clear();
+	}
+	size_t GetBytes() const { return mBytes; }
+	double GetIOTime() const { return mIOTime; }
+	const std::string& GetBuffer() const { return mBuffer; }
+
+private:
+
+	static constexpr size_t msChunkSize = 1 << 16;
+	GPMCanvas* mCanvas;
+	FILE* mFile;
+	bool mHold;
+	std::string mBuffer;
+	std::ostringstream mStream;
+	size_t mBytes;
+	double mIOTime;
 };
-struct OutputFunc2
+struct OutputFunc
 {
 	template <class ...Args>
-	void operator()(Args&& ...args)
+	void operator()(Args&& ...args) const
 	{
-		Print(ofs, std::forward<Args>(args)...);
+		w->Append(std::forward<Args>(args)...);
 	}
-	std::ofstream& ofs;
+	DataWriter* w;
 };
 template <class ...Args>
 inline void MakeDataObject(GPMCanvas* g, const std::string& name, Args&& ...args)
 {
-	if (g->IsInMemoryDataTransferEnabled()) 
+	TraceScope trace("Serialize", name);
+	auto t0 = std::chrono::steady_clock::now();
+	GPMSeriesStats stats;
+	stats.mName = name;
+	if (g->IsInMemoryDataTransferEnabled() && g->IsDataBlockReuseEnabled())
+	{
+		//内容が前回と同じであれば、gnuplotに残っているdatablockをそのまま使う。
+		DataWriter w(g, nullptr, true);
+		stats.mRows = MakeDataObjectCommon(OutputFunc{ &w }, std::forward<Args>(args)...);
+		Fnv1a64 hash;
+		hash.Update(w.GetBuffer().data(), w.GetBuffer().size());
+		if (g->UpdateDataBlockHash(name, hash.Get()))
+		{
+			g->Command(name + " << EOD");
+			w.Write();
+			g->Command("EOD");
+		}
+		stats.mBytes = w.GetBytes();
+		stats.mIOTime = w.GetIOTime();
+	}
+	else if (g->IsInMemoryDataTransferEnabled())
 	{
 		// make datablock
 		g->Command(name + " << EOD");
-		OutputFunc1 output_func{ g };
-		MakeDataObjectCommon(output_func, std::forward<Args>(args)...);
+		DataWriter w(g, nullptr);
+		stats.mRows = MakeDataObjectCommon(OutputFunc{ &w }, std::forward<Args>(args)...);
+		w.Write();
 		g->Command("EOD");
+		stats.mBytes = w.GetBytes();
+		stats.mIOTime = w.GetIOTime();
 	}
 	else
 	{
 		// make file
-		std::ofstream ofs(name);
-		if (!ofs) throw InvalidArg("file \"" + name + "\" cannot open.");
-		OutputFunc2 output_func{ ofs };
-		MakeDataObjectCommon(output_func, std::forward<Args>(args)...);
+		std::unique_ptr<FILE, int(*)(FILE*)> fp(fopen(g->GetDataFilePath(name).c_str(), "w"), &fclose);
+		if (!fp) throw InvalidArg("file \"" + name + "\" cannot open.");
+		DataWriter w(g, fp.get());
+		stats.mRows = MakeDataObjectCommon(OutputFunc{ &w }, std::forward<Args>(args)...);
+		w.Write();
+		auto t1 = std::chrono::steady_clock::now();
+		fp.reset();
+		stats.mBytes = w.GetBytes();
+		stats.mIOTime = w.GetIOTime() + GetElapsedTime(t1);
 	}
+	stats.mSerializeTime = GetElapsedTime(t0);
+	g->AddSeriesStats(std::move(stats));
 }
 
 // Replace non-alphanumeric characters with '_'
@@ -493,6 +1146,94 @@ inline std::string SanitizeForDataBlock(const std::string& str)
 	return res;
 }
 
+//smoothオプションをC++側で計算できるかどうか。
+//x、yが数値の配列で与えられ、エラーバーなど平滑化と両立しない列を持たない場合に限る。
+//ただしacsplinesについては、gnuplotと同様にyerrorbarの列をそのまま各点の重みとして用いる。
+template <class PointParam>
+bool IsNativeSmoothable(const PointParam& p)
+{
+	switch (p.mSmooth)
+	{
+	case Smooth::unique:
+	case Smooth::frequency:
+	case Smooth::cumulative:
+	case Smooth::cnormal:
+	case Smooth::csplines:
+	case Smooth::bezier:
+	case Smooth::sbezier:
+		if (p.mYErrorbar) return false;
+		break;
+	case Smooth::acsplines:
+		if (p.mYErrorbar && p.mYErrorbar.GetType() != plot::ArrayData::DBLVEC) return false;
+		break;
+	default:
+		return false;
+	}
+	if (p.mX.GetType() != plot::ArrayData::DBLVEC || p.mY.GetType() != plot::ArrayData::DBLVEC) return false;
+	if (p.mXErrorbar || p.mVariableColor || p.mVariableSize) return false;
+	return true;
+}
+//p.mSmoothに従って平滑化した曲線を、出力画像の解像度で見分けのつかない程度の点数でx、yに格納する。
+//decimateがfalseの場合、cumulative、cnormalは間引かずに全点を格納する。
+//間引きの誤差は線形で自動範囲のy軸を前提としているので、対数軸や範囲が指定されている場合はfalseとする。
+template <class PointParam>
+void SmoothNatively(const PointParam& p, std::pair<int, int> resolution, bool decimate, std::vector<double>& x, std::vector<double>& y)
+{
+	size_t nsamples = (size_t)std::max(resolution.first, 2);
+	switch (p.mSmooth)
+	{
+	case Smooth::unique:
+	case Smooth::frequency:
+	{
+		SmoothPoints points = SortPoints(p.mX.GetVector(), p.mY.GetVector());
+		ImplodePoints(points, p.mSmooth == Smooth::unique);
+		CopyPoints(points, x, y);
+		break;
+	}
+	case Smooth::cumulative:
+	case Smooth::cnormal:
+	{
+		SmoothPoints points = SortPoints(p.mX.GetVector(), p.mY.GetVector());
+		ImplodePoints(points, false);
+		AccumulatePoints(points, p.mSmooth == Smooth::cnormal);
+		if (decimate) DecimatePoints(points, resolution.first, resolution.second, x, y);
+		else CopyPoints(points, x, y);
+		break;
+	}
+	case Smooth::csplines:
+	{
+		SmoothPoints points = SortPoints(p.mX.GetVector(), p.mY.GetVector());
+		ImplodePoints(points, true);
+		CubicSplinePoints(points, nsamples, x, y);
+		break;
+	}
+	case Smooth::acsplines:
+	{
+		//gnuplotに任せた場合（using x:y:yerrorbar smooth acsplines）と同じ曲線になるよう、yerrorbarを変換せずに重みとする。
+		SmoothPoints points = SortPoints(p.mX.GetVector(), p.mY.GetVector(), p.mYErrorbar ? &p.mYErrorbar.GetVector() : nullptr);
+		ImplodePoints(points, true);
+		ApproxSplinePoints(points, nsamples, x, y);
+		break;
+	}
+	case Smooth::bezier:
+	{
+		//bezierは与えられた順序の点列を制御点とする。
+		SmoothPoints points = MakePoints(p.mX.GetVector(), p.mY.GetVector());
+		BezierPoints(points, nsamples, x, y);
+		break;
+	}
+	case Smooth::sbezier:
+	{
+		SmoothPoints points = SortPoints(p.mX.GetVector(), p.mY.GetVector());
+		ImplodePoints(points, true);
+		BezierPoints(points, nsamples, x, y);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
 template <class PointParam>
 std::string PointPlotCommand(const PointParam& p)
 {
@@ -649,9 +1390,10 @@ std::string FilledCurveplotCommand(const FilledCurveParam& f)
 	c += " filledcurves";
 
 	if (!f.mClosed && !f.mAbove && !f.mBelow &&
-		f.mBaseline.empty())
+		f.mBaseline.empty() && !f.mY2)
 	{
 		//何も指定のないデフォルトの場合、x1軸との間の領域を塗りつぶす。
+		//y2が与えられている場合は、gnuplotのデフォルトでyとy2の間が塗りつぶされる。
 		c += " x1";
 	}
 
@@ -678,6 +1420,33 @@ std::string FilledCurveplotCommand(const FilledCurveParam& f)
 	}
 	return c;
 }
+template <class CandlestickParam>
+std::string CandlestickPlotCommand(const CandlestickParam& p)
+{
+	std::string c;
+	c += " candlesticks";
+	if (p.mWhiskerBars >= 0) c += Format(" whiskerbars %lf", p.mWhiskerBars);
+	if (p.mLineType != -2) c += " linetype " + std::to_string(p.mLineType);
+	if (p.mLineWidth != -1) c += " linewidth " + std::to_string(p.mLineWidth);
+	if (!p.mColor.empty()) c += " linecolor '" + p.mColor + "'";
+
+	if (!p.mFillColor.empty()) c += " fillcolor '" + p.mFillColor + "'";
+	{
+		std::string fs;
+		if (p.mTransparent) fs += " transparent";
+		if (p.mSolid != -1) fs += Format(" solid %lf", p.mSolid);
+		else if (p.mPattern != -1) fs += Format(" pattern %d", p.mPattern);
+		if (!fs.empty()) c += " fillstyle" + fs;
+	}
+	{
+		std::string bd;
+		if (p.mBorderType == -2) bd += Format(" noborder");
+		else if (p.mBorderType != -3) bd += Format(" %d", p.mBorderType);
+		if (!p.mBorderColor.empty()) bd += " linecolor '" + p.mBorderColor + "'";
+		if (!bd.empty()) c += " border" + bd;
+	}
+	return c;
+}
 template <class GraphParam>
 std::string ColormapPlotCommand(const GraphParam& p)
 {
@@ -746,6 +1515,8 @@ struct PointOption : public LineOption {};
 struct VectorOption : public LineOption {};
 struct FillOption : public BaseOption {};
 struct FilledCurveOption : public FillOption {};
+struct CandlestickOption : public LineOption, public FillOption {};
+struct ErrorBandOption : public LineOption, public FillOption {};
 
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(x, ArrayData, BaseOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(y, ArrayData, BaseOption)
@@ -760,6 +1531,7 @@ CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(variable_color, ArrayData, LineOptio
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(style, Style, PointOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(pointtype, int, PointOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(pointsize, double, PointOption)
+//acsplinesでは、gnuplotと同様にyerrorbarの値を各点の重みとして用いる（標準偏差ではない）。大きいほど曲線が点に近づく。
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(smooth, Smooth, PointOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(xerrorbar, ArrayData, PointOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(yerrorbar, ArrayData, PointOption)
@@ -783,6 +1555,13 @@ CUF_DEFINE_TAGGED_KEYWORD_OPTION(closed, FilledCurveOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION(above, FilledCurveOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION(below, FilledCurveOption)
 
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(boxwidth, double, CandlestickOption)//x軸の単位での箱の幅。
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(whiskerbars, double, CandlestickOption)//ひげの先端の横棒の、箱の幅に対する長さ。
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(whiskerrange, double, CandlestickOption)//PlotBoxesのひげの長さ（IQRの倍数）。0以下なら最小値、最大値まで伸ばす。
+CUF_DEFINE_TAGGED_KEYWORD_OPTION(without_outliers, CandlestickOption)//PlotBoxesで外れ値を描かない。
+
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(nsigma, double, ErrorBandOption)//帯の幅を標準偏差の何倍にするか。デフォルトは1。
+
 }
 
 namespace detail
@@ -899,6 +1678,57 @@ struct GPMFilledCurveParam
 	bool mBelow;
 };
 
+struct GPMCandlestickParam
+{
+	GPMCandlestickParam()
+		: mLineType(-2), mLineWidth(-1),
+		mPattern(-1), mSolid(-1), mTransparent(false), mBorderType(-3),
+		mBoxWidth(-1), mWhiskerBars(-1), mWhiskerRange(1.5), mWithoutOutliers(false)
+	{}
+
+	template <class ...Ops>
+	void SetOptions(Ops ...ops)
+	{
+		mLineType = GetKeywordArg(plot::linetype, ops..., -2);
+		mLineWidth = GetKeywordArg(plot::linewidth, ops..., -1);
+		mColor = GetKeywordArg(plot::color, ops..., "");
+		mFillColor = GetKeywordArg(plot::fillcolor, ops..., "");
+		mPattern = GetKeywordArg(plot::fillpattern, ops..., -1);
+		mSolid = GetKeywordArg(plot::fillsolid, ops..., -1.);
+		mTransparent = KeywordExists(plot::filltransparent, ops...);
+		mBorderColor = GetKeywordArg(plot::bordercolor, ops..., "");
+		mBorderType = GetKeywordArg(plot::bordertype, ops..., -3);
+		mBoxWidth = GetKeywordArg(plot::boxwidth, ops..., -1.);
+		mWhiskerBars = GetKeywordArg(plot::whiskerbars, ops..., -1.);
+		mWhiskerRange = GetKeywordArg(plot::whiskerrange, ops..., 1.5);
+		mWithoutOutliers = KeywordExists(plot::without_outliers, ops...);
+	}
+
+	//LineOption
+	int mLineType;//-2ならデフォルト
+	double mLineWidth;//-1ならデフォルト
+	std::string mColor;
+
+	//FillOption
+	std::string mFillColor;
+	int mPattern;
+	double mSolid;
+	bool mTransparent;
+	std::string mBorderColor;
+	int mBorderType;//-2はnorborderを意味する。
+
+	//CandlestickOption
+	double mBoxWidth;//-1ならデフォルト。
+	double mWhiskerBars;//-1ならひげの先端に横棒を付けない。
+	double mWhiskerRange;
+	bool mWithoutOutliers;
+	plot::ArrayData mX;
+	plot::ArrayData mBoxMin;
+	plot::ArrayData mWhiskerMin;
+	plot::ArrayData mWhiskerMax;
+	plot::ArrayData mBoxMax;
+};
+
 template <class ...Styles>
 struct GPMGraphParamBase : public Variant<Styles...>
 {
@@ -924,15 +1754,17 @@ struct GPMGraphParamBase : public Variant<Styles...>
 
 	std::vector<std::string> mColumn;
 };
-struct GPMGraphParam2D : public GPMGraphParamBase<GPMPointParam, GPMVectorParam, GPMFilledCurveParam>
+struct GPMGraphParam2D : public GPMGraphParamBase<GPMPointParam, GPMVectorParam, GPMFilledCurveParam, GPMCandlestickParam>
 {
 	void AssignPoint() { Emplace<GPMPointParam>(); }
 	void AssignVector() { Emplace<GPMVectorParam>(); }
 	void AssignFilledCurve() { Emplace<GPMFilledCurveParam>(); }
+	void AssignCandlestick() { Emplace<GPMCandlestickParam>(); }
 
 	bool IsPoint() const { return Is<GPMPointParam>(); }
 	bool IsVector() const { return Is<GPMVectorParam>(); }
 	bool IsFilledCurve() const { return Is<GPMFilledCurveParam>(); }
+	bool IsCandlestick() const { return Is<GPMCandlestickParam>(); }
 
 	GPMPointParam& GetPointParam() { return Get<GPMPointParam>(); }
 	const GPMPointParam& GetPointParam() const { return Get<GPMPointParam>(); }
@@ -940,6 +1772,8 @@ struct GPMGraphParam2D : public GPMGraphParamBase<GPMPointParam, GPMVectorParam,
 	const GPMVectorParam& GetVectorParam() const { return Get<GPMVectorParam>(); }
 	GPMFilledCurveParam& GetFilledCurveParam() { return Get<GPMFilledCurveParam>(); }
 	const GPMFilledCurveParam& GetFilledCurveParam() const { return Get<GPMFilledCurveParam>(); }
+	GPMCandlestickParam& GetCandlestickParam() { return Get<GPMCandlestickParam>(); }
+	const GPMCandlestickParam& GetCandlestickParam() const { return Get<GPMCandlestickParam>(); }
 };
 
 
@@ -958,6 +1792,8 @@ struct GPMPlotBuffer2D
 	template <class Type1, class Type2, class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	GPMPlotBuffer2D PlotPoints(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
+	GPMPlotBuffer2D PlotPoints(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	GPMPlotBuffer2D PlotPoints(const std::string& filename, const std::string& xcol, const std::string& ycol, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	GPMPlotBuffer2D PlotPoints(const std::string& equation, Options ...ops);
@@ -965,6 +1801,8 @@ struct GPMPlotBuffer2D
 	template <class Type1, class Type2, class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	GPMPlotBuffer2D PlotLines(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
+	GPMPlotBuffer2D PlotLines(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	GPMPlotBuffer2D PlotLines(const std::string& filename, const std::string& xcol, const std::string& ycol, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	GPMPlotBuffer2D PlotLines(const std::string& equation, Options ...ops);
@@ -990,12 +1828,30 @@ struct GPMPlotBuffer2D
 	GPMPlotBuffer2D PlotFilledCurves(const std::string& filename, const std::string& x, const std::string& y, const std::string& y2,
 									 Options ...ops);
 
+	template <class Type1, class Type2, class Type3, class Type4, class Type5, class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	GPMPlotBuffer2D PlotCandlesticks(const std::vector<Type1>& x, const std::vector<Type2>& boxmin,
+									 const std::vector<Type3>& whiskermin, const std::vector<Type4>& whiskermax,
+									 const std::vector<Type5>& boxmax, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	GPMPlotBuffer2D PlotCandlesticks(const std::string& filename, const std::string& x, const std::string& boxmin,
+									 const std::string& whiskermin, const std::string& whiskermax,
+									 const std::string& boxmax, Options ...ops);
+
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	GPMPlotBuffer2D PlotBoxes(const std::vector<double>& x, const std::vector<double>& y, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	GPMPlotBuffer2D PlotBoxes(std::vector<std::vector<double>> groups, Options ...ops);
+
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ErrorBandOption)>
+	GPMPlotBuffer2D PlotErrorBand(const std::vector<double>& x, const std::vector<OnlineStatistics>& stats, Options ...ops);
+
 protected:
 
 	GPMPlotBuffer2D Plot(GraphParam& i);
+	template <class ...Options>
+	GPMPlotBuffer2D PlotBoxSummaries(const plot::ArrayData& x, const std::vector<BoxSummary>& s, Options ...ops);
 
 	static std::string PlotCommand(const GraphParam& i, const bool IsInMemoryDataTransferEnabled);
-	static std::string InitCommand();
 
 	std::vector<GraphParam> mParam;
 	GPMCanvas* mCanvas;
@@ -1014,6 +1870,8 @@ public:
 	template <class Type1, class Type2, class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	_Buffer PlotPoints(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
+	_Buffer PlotPoints(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	_Buffer PlotPoints(const std::string& filename, const std::string& xcol, const std::string& ycol, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	_Buffer PlotPoints(const std::string& equation, Options ...ops);
@@ -1021,6 +1879,8 @@ public:
 	template <class Type1, class Type2, class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	_Buffer PlotLines(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
+	_Buffer PlotLines(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	_Buffer PlotLines(const std::string& filename, const std::string& xcol, const std::string& ycol, Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::PointOption)>
 	_Buffer PlotLines(const std::string& equation, Options ...ops);
@@ -1046,6 +1906,23 @@ public:
 	_Buffer PlotFilledCurves(const std::string& filename, const std::string& x, const std::string& y, const std::string& y2,
 							 Options ...ops);
 
+	template <class Type1, class Type2, class Type3, class Type4, class Type5, class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	_Buffer PlotCandlesticks(const std::vector<Type1>& x, const std::vector<Type2>& boxmin,
+							 const std::vector<Type3>& whiskermin, const std::vector<Type4>& whiskermax,
+							 const std::vector<Type5>& boxmax, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	_Buffer PlotCandlesticks(const std::string& filename, const std::string& x, const std::string& boxmin,
+							 const std::string& whiskermin, const std::string& whiskermax,
+							 const std::string& boxmax, Options ...ops);
+
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	_Buffer PlotBoxes(const std::vector<double>& x, const std::vector<double>& y, Options ...ops);
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::CandlestickOption)>
+	_Buffer PlotBoxes(std::vector<std::vector<double>> groups, Options ...ops);
+
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ErrorBandOption)>
+	_Buffer PlotErrorBand(const std::vector<double>& x, const std::vector<OnlineStatistics>& stats, Options ...ops);
+
 	_Buffer GetBuffer();
 
 };
@@ -1076,6 +1953,9 @@ template <class GraphParam>
 inline void GPMPlotBuffer2D<GraphParam>::Flush()
 {
 	if (mCanvas == nullptr) throw NotInitialized("Buffer is empty");
+	TraceScope trace("Flush", mCanvas->GetOutput());
+	auto t0 = std::chrono::steady_clock::now();
+	size_t bytes = mCanvas->GetBytes();
 	std::string c = "plot";
 	for (auto& i : mParam)
 	{
@@ -1083,7 +1963,8 @@ inline void GPMPlotBuffer2D<GraphParam>::Flush()
 	}
 	c.erase(c.end() - 2, c.end());
 	mCanvas->Command(c);
-	mCanvas->Command(InitCommand());
+	mCanvas->ResetState();
+	mCanvas->AddFlushStats(mCanvas->GetBytes() - bytes, GetElapsedTime(t0));
 }
 template <class GraphParam>
 inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::Plot(GraphParam& i)
@@ -1096,7 +1977,7 @@ inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::Plot(GraphParam&
 		}
 		else
 		{
-			i.mGraph = mCanvas->GetOutput() + ".tmp" + std::to_string(mParam.size()) + ".txt";
+			i.mGraph = mCanvas->GetDataFileName(mCanvas->GetOutput() + ".tmp" + std::to_string(mParam.size()) + ".txt");
 		}
 		auto GET_ARRAY = [](plot::ArrayData& X, const std::string& x,
 							std::vector<DataIterator>& it, std::vector<std::string>& column, std::string& labelcolumn, size_t& size)
@@ -1109,6 +1990,15 @@ inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::Plot(GraphParam&
 				it.emplace_back(X.GetVector().begin());
 				column.emplace_back(std::to_string(it.size()));
 				break;
+			case plot::ArrayData::DBLVIEW:
+			{
+				auto v = X.GetView();
+				if (size == 0) size = v.size();
+				else if (size != v.size()) throw InvalidArg("The number of " + x + " does not match with the others.");
+				it.emplace_back(v.begin());
+				column.emplace_back(std::to_string(it.size()));
+				break;
+			}
 			case plot::ArrayData::STRVEC:
 				if (size == 0) size = X.GetStrVec().size();
 				else if (size != X.GetStrVec().size()) throw InvalidArg("The number of " + x + " does not match with the others.");
@@ -1130,6 +2020,11 @@ inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::Plot(GraphParam&
 		std::string labelcolumn;
 		size_t size = 0;
 
+		//C++側で平滑化した場合の結果。MakeDataObjectまで生存している必要がある。
+		std::vector<double> smoothx, smoothy;
+		//ラベルで位置が与えられた箱の、数値としての位置。
+		std::vector<double> positions;
+
 		//ファイルを作成する。
 		if (i.IsPoint())
 		{
@@ -1137,13 +2032,26 @@ inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::Plot(GraphParam&
 			if (!p.mX) throw InvalidArg("x coordinate list is not given.");
 			if (!p.mY) throw InvalidArg("y coordinate list is not given.");
 
-			GET_ARRAY(p.mX, "x", it, column, labelcolumn, size);
-			GET_ARRAY(p.mY, "y", it, column, labelcolumn, size);
+			if (mCanvas->IsNativeSmoothingEnabled() && IsNativeSmoothable(p))
+			{
+				//平滑化済みの点だけを送り、gnuplotにはsmoothオプションを渡さない。
+				SmoothNatively(p, mCanvas->GetResolution(), mCanvas->IsLinearAutoscale(), smoothx, smoothy);
+				p.mSmooth = Smooth::none;
+				p.mYErrorbar = plot::ArrayData();
+				plot::ArrayData sx(smoothx), sy(smoothy);
+				GET_ARRAY(sx, "x", it, column, labelcolumn, size);
+				GET_ARRAY(sy, "y", it, column, labelcolumn, size);
+			}
+			else
+			{
+				GET_ARRAY(p.mX, "x", it, column, labelcolumn, size);
+				GET_ARRAY(p.mY, "y", it, column, labelcolumn, size);
 
-			if (p.mXErrorbar) GET_ARRAY(p.mXErrorbar, "xerrorbar", it, column, labelcolumn, size);
-			if (p.mYErrorbar) GET_ARRAY(p.mYErrorbar, "yerrorbar", it, column, labelcolumn, size);
-			if (p.mVariableColor) GET_ARRAY(p.mVariableColor, "variable_color", it, column, labelcolumn, size);
-			if (p.mVariableSize) GET_ARRAY(p.mVariableSize, "variable_size", it, column, labelcolumn, size);
+				if (p.mXErrorbar) GET_ARRAY(p.mXErrorbar, "xerrorbar", it, column, labelcolumn, size);
+				if (p.mYErrorbar) GET_ARRAY(p.mYErrorbar, "yerrorbar", it, column, labelcolumn, size);
+				if (p.mVariableColor) GET_ARRAY(p.mVariableColor, "variable_color", it, column, labelcolumn, size);
+				if (p.mVariableSize) GET_ARRAY(p.mVariableSize, "variable_size", it, column, labelcolumn, size);
+			}
 		}
 		else if (i.IsVector())
 		{
@@ -1170,6 +2078,33 @@ inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::Plot(GraphParam&
 			if (f.mY2) GET_ARRAY(f.mY2, "y2", it, column, labelcolumn, size);
 			if (f.mVariableColor) GET_ARRAY(f.mVariableColor, "variable_fillcolor", it, column, labelcolumn, size);
 		}
+		else if (i.IsCandlestick())
+		{
+			auto& c = i.GetCandlestickParam();
+			if (!c.mX) throw InvalidArg("x coordinate list is not given.");
+			if (c.mX.GetType() == plot::ArrayData::STRVEC)
+			{
+				//x軸がラベルの場合、箱を0, 1, 2, ...の位置に並べ、ラベルを目盛りとする。
+				positions.resize(c.mX.GetStrVec().size());
+				std::iota(positions.begin(), positions.end(), 0.);
+				plot::ArrayData px(positions);
+				GET_ARRAY(px, "x", it, column, labelcolumn, size);
+			}
+			GET_ARRAY(c.mX, "x", it, column, labelcolumn, size);
+			if (!c.mBoxMin) throw InvalidArg("box_min list is not given.");
+			GET_ARRAY(c.mBoxMin, "box_min", it, column, labelcolumn, size);
+			if (!c.mWhiskerMin) throw InvalidArg("whisker_min list is not given.");
+			GET_ARRAY(c.mWhiskerMin, "whisker_min", it, column, labelcolumn, size);
+			if (!c.mWhiskerMax) throw InvalidArg("whisker_max list is not given.");
+			GET_ARRAY(c.mWhiskerMax, "whisker_max", it, column, labelcolumn, size);
+			if (!c.mBoxMax) throw InvalidArg("box_max list is not given.");
+			GET_ARRAY(c.mBoxMax, "box_max", it, column, labelcolumn, size);
+			if (c.mBoxWidth >= 0)
+			{
+				plot::ArrayData w(c.mBoxWidth);
+				GET_ARRAY(w, "boxwidth", it, column, labelcolumn, size);
+			}
+		}
 		MakeDataObject(mCanvas, i.mGraph, it, size);
 		if (!labelcolumn.empty()) column.emplace_back(std::move(labelcolumn));
 		i.mColumn = std::move(column);
@@ -1224,6 +2159,21 @@ inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::Plot(GraphParam&
 			if (f.mY2) ADD_COLUMN(f.mY2, "y2", column);
 			if (f.mVariableColor) ADD_COLUMN(f.mVariableColor, "variable_fillcolor", column);
 		}
+		else if (i.IsCandlestick())
+		{
+			auto& c = i.GetCandlestickParam();
+			if (!c.mX) throw InvalidArg("x coordinate list is not given.");
+			ADD_COLUMN(c.mX, "x", column);
+			if (!c.mBoxMin) throw InvalidArg("box_min list is not given.");
+			ADD_COLUMN(c.mBoxMin, "box_min", column);
+			if (!c.mWhiskerMin) throw InvalidArg("whisker_min list is not given.");
+			ADD_COLUMN(c.mWhiskerMin, "whisker_min", column);
+			if (!c.mWhiskerMax) throw InvalidArg("whisker_max list is not given.");
+			ADD_COLUMN(c.mWhiskerMax, "whisker_max", column);
+			if (!c.mBoxMax) throw InvalidArg("box_max list is not given.");
+			ADD_COLUMN(c.mBoxMax, "box_max", column);
+			if (c.mBoxWidth >= 0) ADD_COLUMN(plot::ArrayData(c.mBoxWidth), "boxwidth", column);
+		}
 		i.mColumn = std::move(column);
 	}
 	mParam.emplace_back(std::move(i));
@@ -1284,6 +2234,24 @@ PlotPoints(const std::string& equation, Options ...ops)
 	return Plot(i);
 }
 template <class GraphParam>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotPoints(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops)
+{
+	GraphParam i;
+	i.AssignPoint();
+	i.mType = GraphParam::DATA;
+	i.SetBaseOptions(ops...);
+
+	//point
+	auto& p = i.GetPointParam();
+	p.mX = x;
+	p.mY = y;
+	p.SetOptions(ops...);
+
+	return Plot(i);
+}
+template <class GraphParam>
 template <class Type1, class Type2, class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
 PlotLines(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...ops)
@@ -1293,6 +2261,13 @@ PlotLines(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...o
 template <class GraphParam>
 template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotLines(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops)
+{
+	return PlotPoints(x, y, plot::style = Style::lines, ops...);
+}
+template <class GraphParam>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
 PlotLines(const std::string& filename, const std::string& xcol, const std::string& ycol, Options ...ops)
 {
 	return PlotPoints(filename, xcol, ycol, plot::style = Style::lines, ops...);
@@ -1418,6 +2393,209 @@ PlotFilledCurves(const std::string& filename, const std::string& x, const std::s
 	f.SetOptions(ops...);
 	return Plot(p);
 }
+template <class GraphParam>
+template <class Type1, class Type2, class Type3, class Type4, class Type5, class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotCandlesticks(const std::vector<Type1>& x, const std::vector<Type2>& boxmin,
+				 const std::vector<Type3>& whiskermin, const std::vector<Type4>& whiskermax,
+				 const std::vector<Type5>& boxmax, Options ...ops)
+{
+	GraphParam p;
+	p.AssignCandlestick();
+	p.mType = GraphParam::DATA;
+	p.SetBaseOptions(ops...);
+
+	auto& c = p.GetCandlestickParam();
+	c.mX = x;
+	c.mBoxMin = boxmin;
+	c.mWhiskerMin = whiskermin;
+	c.mWhiskerMax = whiskermax;
+	c.mBoxMax = boxmax;
+	c.SetOptions(ops...);
+	return Plot(p);
+}
+template <class GraphParam>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotCandlesticks(const std::string& filename, const std::string& x, const std::string& boxmin,
+				 const std::string& whiskermin, const std::string& whiskermax,
+				 const std::string& boxmax, Options ...ops)
+{
+	GraphParam p;
+	p.AssignCandlestick();
+	p.mType = GraphParam::FILE;
+	p.mGraph = filename;
+	p.SetBaseOptions(ops...);
+
+	auto& c = p.GetCandlestickParam();
+	c.mX = x;
+	c.mBoxMin = boxmin;
+	c.mWhiskerMin = whiskermin;
+	c.mWhiskerMax = whiskermax;
+	c.mBoxMax = boxmax;
+	c.SetOptions(ops...);
+	return Plot(p);
+}
+//xの値が等しいyの集まりを一つのグループとみなし、グループごとの箱ひげ図を描く。
+template <class GraphParam>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotBoxes(const std::vector<double>& x, const std::vector<double>& y, Options ...ops)
+{
+	//xで並列にソートしてから、xの等しい区間ごとにyを切り出す。
+	SmoothPoints points = SortPoints(x, y);
+	std::vector<double> keys;
+	std::vector<std::vector<double>> groups;
+	for (size_t b = 0; b < points.size();)
+	{
+		size_t e = b;
+		while (e < points.size() && points[e].x == points[b].x) ++e;
+		keys.push_back(points[b].x);
+		groups.emplace_back(e - b);
+		for (size_t i = b; i < e; ++i) groups.back()[i - b] = points[i].y;
+		b = e;
+	}
+	double whisker = GetKeywordArg(plot::whiskerrange, ops..., 1.5);
+	return PlotBoxSummaries(keys, Summarize(groups, whisker), ops...);
+}
+//groups[i]の箱ひげ図を描く。箱の位置はplot::xに数値またはラベルの配列として与え、省略すれば0, 1, 2, ...に並べる。
+template <class GraphParam>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotBoxes(std::vector<std::vector<double>> groups, Options ...ops)
+{
+	double whisker = GetKeywordArg(plot::whiskerrange, ops..., 1.5);
+	std::vector<BoxSummary> s = Summarize(groups, whisker);
+	std::vector<double> index;
+	plot::ArrayData x;
+	if (KeywordExists(plot::x, ops...)) x = GetKeywordArg(plot::x, ops...);
+	else
+	{
+		index.resize(groups.size());
+		std::iota(index.begin(), index.end(), 0.);
+		x = index;
+	}
+	return PlotBoxSummaries(x, s, ops...);
+}
+//要約統計量から、箱とひげ、中央値の線、外れ値の3つのグラフを作る。
+template <class GraphParam>
+template <class ...Options>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotBoxSummaries(const plot::ArrayData& x, const std::vector<BoxSummary>& s, Options ...ops)
+{
+	size_t n = s.size();
+	if (x.IsNumeric() && x.GetView().size() != n)
+		throw InvalidArg("The number of x does not match with the number of groups.");
+	if (x.GetType() == plot::ArrayData::STRVEC && x.GetStrVec().size() != n)
+		throw InvalidArg("The number of x does not match with the number of groups.");
+	if (!x.IsNumeric() && x.GetType() != plot::ArrayData::STRVEC)
+		throw InvalidArg("x must be given as a numeric or string array.");
+
+	std::vector<double> q1(n), lo(n), hi(n), q3(n), median(n);
+	std::vector<double> outx, outy;
+	for (size_t i = 0; i < n; ++i)
+	{
+		q1[i] = s[i].mQ1;
+		lo[i] = s[i].mLowerWhisker;
+		hi[i] = s[i].mUpperWhisker;
+		q3[i] = s[i].mQ3;
+		median[i] = s[i].mMedian;
+		double pos = x.IsNumeric() ? x.GetView()[(uint32_t)i] : (double)i;
+		for (double o : s[i].mOutliers) outx.push_back(pos), outy.push_back(o);
+	}
+
+	GraphParam box;
+	box.AssignCandlestick();
+	box.mType = GraphParam::DATA;
+	box.SetBaseOptions(ops...);
+	auto& c = box.GetCandlestickParam();
+	c.SetOptions(ops...);
+	if (!KeywordExists(plot::whiskerbars, ops...)) c.mWhiskerBars = 0.5;
+	c.mX = x;
+
+	//中央値は、上下の端が一致した箱として描く。
+	GraphParam med = box;
+	med.mTitle = "notitle";
+	auto& m = med.GetCandlestickParam();
+	m.mWhiskerBars = -1;
+	m.mSolid = -1;
+	m.mPattern = -1;
+	m.mTransparent = false;
+	m.mBoxMin = median;
+	m.mWhiskerMin = median;
+	m.mWhiskerMax = median;
+	m.mBoxMax = median;
+
+	c.mBoxMin = q1;
+	c.mWhiskerMin = lo;
+	c.mWhiskerMax = hi;
+	c.mBoxMax = q3;
+	bool withoutoutliers = c.mWithoutOutliers;
+	std::string color = c.mColor;
+
+	GPMPlotBuffer2D r = Plot(box).Plot(med);
+	if (withoutoutliers || outx.empty()) return r;
+
+	GraphParam out;
+	out.AssignPoint();
+	out.mType = GraphParam::DATA;
+	out.mTitle = "notitle";
+	out.mAxis = med.mAxis;
+	auto& p = out.GetPointParam();
+	p.mStyle = Style::points;
+	p.mPointType = 6;
+	p.mColor = color;
+	p.mX = outx;
+	p.mY = outy;
+	return r.Plot(out);
+}
+//stats[i]の平均値を線で、平均値±nsigma*標準偏差の範囲を塗りつぶしで描く。
+//線にはLineOption、帯にはFillOptionが適用される。fillcolorを省略すると線と同じ色で、半透明に塗りつぶす。
+template <class GraphParam>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBuffer2D<GraphParam> GPMPlotBuffer2D<GraphParam>::
+PlotErrorBand(const std::vector<double>& x, const std::vector<OnlineStatistics>& stats, Options ...ops)
+{
+	if (x.size() != stats.size()) throw InvalidArg("The number of x does not match with the number of statistics.");
+	double k = GetKeywordArg(plot::nsigma, ops..., 1.);
+	std::vector<double> mean(x.size()), lo(x.size()), hi(x.size());
+	for (size_t i = 0; i < x.size(); ++i)
+	{
+		double s = stats[i].GetStdDev();
+		mean[i] = stats[i].GetMean();
+		lo[i] = mean[i] - k * s;
+		hi[i] = mean[i] + k * s;
+	}
+
+	GraphParam band;
+	band.AssignFilledCurve();
+	band.mType = GraphParam::DATA;
+	band.SetBaseOptions(ops...);
+	band.mTitle = "notitle";
+	auto& f = band.GetFilledCurveParam();
+	f.SetOptions(ops...);
+	if (f.mFillColor.empty()) f.mFillColor = GetKeywordArg(plot::color, ops..., "");
+	if (f.mSolid == -1 && f.mPattern == -1)
+	{
+		f.mSolid = 0.3;
+		f.mTransparent = true;
+	}
+	f.mX = x;
+	f.mY = lo;
+	f.mY2 = hi;
+
+	GraphParam line;
+	line.AssignPoint();
+	line.mType = GraphParam::DATA;
+	line.SetBaseOptions(ops...);
+	auto& p = line.GetPointParam();
+	p.SetOptions(ops...);
+	p.mStyle = Style::lines;
+	p.mX = x;
+	p.mY = mean;
+
+	return Plot(band).Plot(line);
+}
 
 template <class GraphParam>
 inline std::string GPMPlotBuffer2D<GraphParam>::PlotCommand(const GraphParam& p, const bool IsInMemoryDataTransferEnabled)
@@ -1481,23 +2659,16 @@ inline std::string GPMPlotBuffer2D<GraphParam>::PlotCommand(const GraphParam& p,
 	{
 		c += FilledCurveplotCommand(p.GetFilledCurveParam());
 	}
+	else if (p.IsCandlestick())
+	{
+		c += CandlestickPlotCommand(p.GetCandlestickParam());
+	}
 
 	//axis
 	if (!p.mAxis.empty()) c += " axes " + p.mAxis;
 
 	return c;
 }
-template <class GraphParam>
-inline std::string GPMPlotBuffer2D<GraphParam>::InitCommand()
-{
-	std::string c;
-	c += "set autoscale\n";
-	c += "unset logscale\n";
-	c += "unset title\n";
-	c += "unset grid\n";
-	c += "set size noratio\n";
-	return c;
-}
 
 template <class GraphParam, template <class> class Buffer>
 template <class Type1, class Type2, class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
@@ -1510,6 +2681,14 @@ PlotPoints(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...
 template <class GraphParam, template <class> class Buffer>
 template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
+PlotPoints(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops)
+{
+	_Buffer r(this);
+	return r.PlotPoints(x, y, ops...);
+}
+template <class GraphParam, template <class> class Buffer>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
 PlotPoints(const std::string& filename, const std::string& xcol, const std::string& ycol, Options ...ops)
 {
 	_Buffer r(this);
@@ -1535,6 +2714,14 @@ PlotLines(const std::vector<Type1>& x, const std::vector<Type2>& y, Options ...o
 template <class GraphParam, template <class> class Buffer>
 template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
+PlotLines(const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y, Options ...ops)
+{
+	_Buffer r(this);
+	return r.PlotLines(x, y, ops...);
+}
+template <class GraphParam, template <class> class Buffer>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
 PlotLines(const std::string& filename, const std::string& xcol, const std::string& ycol, Options ...ops)
 {
 	_Buffer r(this);
@@ -1603,6 +2790,52 @@ PlotFilledCurves(const std::string& filename, const std::string& x, const std::s
 	_Buffer r(this);
 	return r.PlotFilledCurves(filename, x, y, y2, ops...);
 }
+template <class GraphParam, template <class> class Buffer>
+template <class Type1, class Type2, class Type3, class Type4, class Type5, class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
+PlotCandlesticks(const std::vector<Type1>& x, const std::vector<Type2>& boxmin,
+				 const std::vector<Type3>& whiskermin, const std::vector<Type4>& whiskermax,
+				 const std::vector<Type5>& boxmax, Options ...ops)
+{
+	_Buffer r(this);
+	return r.PlotCandlesticks(x, boxmin, whiskermin, whiskermax, boxmax, ops...);
+}
+template <class GraphParam, template <class> class Buffer>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
+PlotCandlesticks(const std::string& filename, const std::string& x, const std::string& boxmin,
+				 const std::string& whiskermin, const std::string& whiskermax,
+				 const std::string& boxmax, Options ...ops)
+{
+	_Buffer r(this);
+	return r.PlotCandlesticks(filename, x, boxmin, whiskermin, whiskermax, boxmax, ops...);
+}
+template <class GraphParam, template <class> class Buffer>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
+PlotBoxes(const std::vector<double>& x, const std::vector<double>& y, Options ...ops)
+{
+	_Buffer r(this);
+	return r.PlotBoxes(x, y, ops...);
+}
+template <class GraphParam, template <class> class Buffer>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
+PlotBoxes(std::vector<std::vector<double>> groups, Options ...ops)
+{
+	_Buffer r(this);
+	return r.PlotBoxes(std::move(groups), ops...);
+}
+
+template <class GraphParam, template <class> class Buffer>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::
+PlotErrorBand(const std::vector<double>& x, const std::vector<OnlineStatistics>& stats, Options ...ops)
+{
+	_Buffer r(this);
+	return r.PlotErrorBand(x, stats, ops...);
+}
+
 template <class GraphParam, template <class> class Buffer>
 inline Buffer<GraphParam> GPMCanvas2D<GraphParam, Buffer>::GetBuffer()
 {
@@ -1630,6 +2863,10 @@ CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(xcoord, const ArrayData&, ColormapOp
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(ycoord, const ArrayData&, ColormapOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(xrange, CUF_TIE_ARGS(std::pair<double, double>), ColormapOption)
 CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(yrange, CUF_TIE_ARGS(std::pair<double, double>), ColormapOption)
+//mapが出力画像の解像度より大きい場合に、ResampleMethodで解像度まで縮小してから書き出す。
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(downsample, ResampleMethod, ColormapOption)
+//mapのうちこの値（NaNならNaN）のセルは書き出さず、全体を覆う背景として1つの四角形で塗る。大部分が空の行列に用いる。
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(skip_value, double, ColormapOption)
 
 //options for contour plot
 CUF_DEFINE_TAGGED_KEYWORD_OPTION(with_contour, ColormapOption)
@@ -1684,7 +2921,9 @@ struct GPMColormapParam
 		: mXRange(DBL_MAX, -DBL_MAX), mYRange(DBL_MAX, -DBL_MAX),
 		mWithContour(false), mWithoutSurface(false), mCntrSmooth(CntrSmooth::none),
 		mCntrPoints(-1), mCntrOrder(-1), mCntrLevelsAuto(-1), mCntrLevelsIncremental(0, 0, 0),
-		mVariableCntrColor(false), mCntrLineType(-2), mCntrLineWidth(-1.)
+		mVariableCntrColor(false), mCntrLineType(-2), mCntrLineWidth(-1.),
+		mDownsample(false), mDownsampleMethod(ResampleMethod::mean),
+		mSparse(false), mSkipValue(0.)
 	{}
 
 	template <class ...Ops>
@@ -1702,6 +2941,10 @@ struct GPMColormapParam
 		mVariableCntrColor = KeywordExists(plot::variable_cntrcolor, ops...);
 		mCntrLineType = GetKeywordArg(plot::cntrlinetype, ops..., -2);
 		mCntrLineWidth = GetKeywordArg(plot::cntrlinewidth, ops..., -1.);
+		mDownsample = KeywordExists(plot::downsample, ops...);
+		mDownsampleMethod = GetKeywordArg(plot::downsample, ops..., ResampleMethod::mean);
+		mSparse = KeywordExists(plot::skip_value, ops...);
+		mSkipValue = GetKeywordArg(plot::skip_value, ops..., 0.);
 	}
 	//ColormapOption
 	plot::ArrayData mXCoord;
@@ -1722,6 +2965,11 @@ struct GPMColormapParam
 	bool mVariableCntrColor;
 	int mCntrLineType;
 	double mCntrLineWidth;
+
+	bool mDownsample;
+	ResampleMethod mDownsampleMethod;
+	bool mSparse;
+	double mSkipValue;
 };
 
 template <class PointParam, class VectorParam, class FilledCurveParam, class ColormapParam>
@@ -1817,11 +3065,16 @@ struct GPMPlotBufferCM
 								const std::string& xlen, const std::string& ylen,
 								Options ...ops);
 
+	//mapにはMatrix<double>の他、floatや整数のMatrix、MatrixView、MappedMatrixを与えられる。
+	//mapやx、yにMatrixViewを与えた場合は、コピーせずにその場で書き出す。mapの要素はdoubleの行列へ変換せず、書き出す際に1つずつ書式化する。
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
+	GPMPlotBufferCM PlotColormap(const plot::MatrixData& map, const std::vector<double>& x, const std::vector<double>& y,
+								 Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
-	GPMPlotBufferCM PlotColormap(const Matrix<double>& map, const std::vector<double>& x, const std::vector<double>& y,
+	GPMPlotBufferCM PlotColormap(const plot::MatrixData& map, std::pair<double, double> x, std::pair<double, double> y,
 								 Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
-	GPMPlotBufferCM PlotColormap(const Matrix<double>& map, std::pair<double, double> x, std::pair<double, double> y,
+	GPMPlotBufferCM PlotColormap(const plot::MatrixData& map, const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y,
 								 Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
 	GPMPlotBufferCM PlotColormap(const std::string& filename, const std::string& z, const std::string& x, const std::string& y,
@@ -1834,7 +3087,6 @@ protected:
 	GPMPlotBufferCM Plot(GraphParam& i);
 
 	static std::string PlotCommand(const GraphParam& i, const bool IsInMemoryDataTransferEnabled);
-	static std::string InitCommand();
 
 	std::vector<GraphParam> mParam;
 	GPMCanvas* mCanvas;
@@ -1849,6 +3101,7 @@ public:
 	using _Buffer = Buffer<GraphParam>;
 
 	GPMCanvasCM(const std::string& output, double sizex = 0., double sizey = 0.);
+	GPMCanvasCM(const std::string& output, std::shared_ptr<GPMCommandSink> sink, double sizex = 0., double sizey = 0.);
 	GPMCanvasCM();
 
 	friend class gpm2::GPMMultiPlot;
@@ -1902,11 +3155,16 @@ public:
 						const std::string& xlen, const std::string& ylen,
 						Options ...ops);
 
+	//mapにはMatrix<double>の他、floatや整数のMatrix、MatrixView、MappedMatrixを与えられる。
+	//mapやx、yにMatrixViewを与えた場合は、コピーせずにその場で書き出す。mapの要素はdoubleの行列へ変換せず、書き出す際に1つずつ書式化する。
+	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
+	_Buffer PlotColormap(const plot::MatrixData& map, const std::vector<double>& x, const std::vector<double>& y,
+						 Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
-	_Buffer PlotColormap(const Matrix<double>& map, const std::vector<double>& x, const std::vector<double>& y,
+	_Buffer PlotColormap(const plot::MatrixData& map, std::pair<double, double> x, std::pair<double, double> y,
 						 Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
-	_Buffer PlotColormap(const Matrix<double>& map, std::pair<double, double> x, std::pair<double, double> y,
+	_Buffer PlotColormap(const plot::MatrixData& map, const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y,
 						 Options ...ops);
 	template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, plot::ColormapOption)>
 	_Buffer PlotColormap(const std::string& filename, const std::string& z, const std::string& x, const std::string& y,
@@ -1936,13 +3194,16 @@ inline GPMPlotBufferCM<GraphParam>& GPMPlotBufferCM<GraphParam>::operator=(GPMPl
 template <class GraphParam>
 inline GPMPlotBufferCM<GraphParam>::~GPMPlotBufferCM()
 {
-	//mPipeがnullptrでないときはこのPlotterが最終処理を担当する。
+	//mCanvasがnullptrでないときはこのPlotterが最終処理を担当する。
 	if (mCanvas != nullptr) Flush();
 }
 template <class GraphParam>
 inline void GPMPlotBufferCM<GraphParam>::Flush()
 {
 	if (mCanvas == nullptr) throw NotInitialized("Buffer is empty");
+	TraceScope trace("Flush", mCanvas->GetOutput());
+	auto t0 = std::chrono::steady_clock::now();
+	size_t bytes = mCanvas->GetBytes();
 	std::string c = "splot";
 	for (auto& i : mParam)
 	{
@@ -1950,26 +3211,27 @@ inline void GPMPlotBufferCM<GraphParam>::Flush()
 	}
 	c.erase(c.end() - 2, c.end());
 	mCanvas->Command(c);
-	mCanvas->Command(InitCommand());
+	mCanvas->ResetState();
+	mCanvas->AddFlushStats(mCanvas->GetBytes() - bytes, GetElapsedTime(t0));
 }
 struct GetCoordFromVector
 {
-	GetCoordFromVector(const std::vector<double>& x)
+	GetCoordFromVector(const MatrixView<const double, 1>& x)
 		: x(x), size(x.size())
 	{
-		wmean = (x.back() - x.front()) / (size - 1);
+		wmean = (x[(uint32_t)size - 1] - x[0]) / (size - 1);
 	}
 	double operator()(size_t i) const
 	{
-		if (i == 0) return x[i] - wmean / 2.;
-		else if (i == size) return x[i - 1] + wmean / 2.;
-		else return (x[i] + x[i - 1]) / 2.;
+		if (i == 0) return x[0] - wmean / 2.;
+		else if (i == size) return x[(uint32_t)i - 1] + wmean / 2.;
+		else return (x[(uint32_t)i] + x[(uint32_t)i - 1]) / 2.;
 	}
 	double center(size_t i) const
 	{
-		return i != size ? x[i] : x[i - 1] + wmean;
+		return i != size ? x[(uint32_t)i] : x[(uint32_t)i - 1] + wmean;
 	}
-	const std::vector<double>& x;
+	MatrixView<const double, 1> x;
 	size_t size;
 	double wmean;
 };
@@ -1995,6 +3257,24 @@ struct GetCoordFromRange
 	size_t size;
 	double width;
 };
+//downsampleで縮小した行列に対応する座標。
+inline std::vector<double> ResampleCoord(const MatrixView<const double, 1>& x, uint32_t size, ResampleMethod method)
+{
+	//最大、最小で縮小した場合も、座標はブロック内の平均とする。
+	if (method == ResampleMethod::max || method == ResampleMethod::min) method = ResampleMethod::mean;
+	MatrixView<const double, 2> v(x.GetData(), { (uint32_t)x.size(), 1 }, { x.GetStride(0), 1 });
+	Matrix<double> r = Resample(v, size, 1, method);
+	return std::vector<double>(r.begin(), r.end());
+}
+inline std::pair<double, double> ResampleRange(const std::pair<double, double>& r, size_t oldsize, uint32_t size)
+{
+	//元のセルの端から端までをsize個のセルで等分し、その両端のセルの中心を返す。
+	double width = (r.second - r.first) / (oldsize - 1);
+	double lo = r.first - width / 2.;
+	double hi = r.second + width / 2.;
+	double w = (hi - lo) / size;
+	return { lo + w / 2., hi - w / 2. };
+}
 template <class GraphParam>
 inline GPMPlotBufferCM<GraphParam> GPMPlotBufferCM<GraphParam>::Plot(GraphParam& i)
 {
@@ -2006,7 +3286,7 @@ inline GPMPlotBufferCM<GraphParam> GPMPlotBufferCM<GraphParam>::Plot(GraphParam&
 		}
 		else
 		{
-			i.mGraph = mCanvas->GetOutput() + ".tmp" + std::to_string(mParam.size()) + ".txt";
+			i.mGraph = mCanvas->GetDataFileName(mCanvas->GetOutput() + ".tmp" + std::to_string(mParam.size()) + ".txt");
 		}
 		auto GET_ARRAY = [](plot::ArrayData& X, const std::string& x,
 							std::vector<DataIterator>& it, std::vector<std::string>& column, std::string& labelcolumn, size_t& size)
@@ -2019,6 +3299,15 @@ inline GPMPlotBufferCM<GraphParam> GPMPlotBufferCM<GraphParam>::Plot(GraphParam&
 				it.emplace_back(X.GetVector().begin());
 				column.emplace_back(std::to_string(it.size()));
 				break;
+			case plot::ArrayData::DBLVIEW:
+			{
+				auto v = X.GetView();
+				if (size == 0) size = v.size();
+				else if (size != v.size()) throw InvalidArg("The number of " + x + " does not match with the others.");
+				it.emplace_back(v.begin());
+				column.emplace_back(std::to_string(it.size()));
+				break;
+			}
 			case plot::ArrayData::STRVEC:
 				if (size == 0) size = X.GetStrVec().size();
 				else if (size != X.GetStrVec().size()) throw InvalidArg("The number of " + x + " does not match with the others.");
@@ -2044,50 +3333,91 @@ inline GPMPlotBufferCM<GraphParam> GPMPlotBufferCM<GraphParam>::Plot(GraphParam&
 			size_t ysize = 0;
 			auto& m = i.GetColormapParam();
 			if (!m.mZMap) throw InvalidArg("z map is not given");
-			if (m.mZMap.GetType() != plot::MatrixData::DBLMAT)
-				throw InvalidArg("z map in the data plot mode must be given in the form of Matrix<double>.");
+			if (!m.mZMap.IsNumeric())
+				throw InvalidArg("z map in the data plot mode must be given in the form of Matrix or MatrixView.");
 
 			//mapがMatrixであるとき、x、yの座標値も配列かrangeで与えられていなければならない。
-			if (!((m.mXCoord && m.mXCoord.GetType() == plot::ArrayData::DBLVEC) ||
+			if (!((m.mXCoord && m.mXCoord.IsNumeric()) ||
 				  m.mXRange != std::make_pair(DBL_MAX, -DBL_MAX))) throw InvalidArg("");
-			if (!((m.mYCoord && m.mYCoord.GetType() == plot::ArrayData::DBLVEC) ||
+			if (!((m.mYCoord && m.mYCoord.IsNumeric()) ||
 				  m.mYRange != std::make_pair(DBL_MAX, -DBL_MAX))) throw InvalidArg("");
 
-			xsize = m.mZMap.GetMatrix().GetSize(0);
-			ysize = m.mZMap.GetMatrix().GetSize(1);
-
+			//ビューはコピーせず、要素の型のままその場で書き出す。
 			column = { "1", "2", "5" };
-			if (m.mXCoord)
+			//疎な行列の空のセルは1つの背景で塗るので、セルの中心から等高線を求めることはできない。
+			if (m.mSparse && m.mWithContour)
+				throw InvalidArg("contour cannot be drawn with skip_value.");
+			auto write = [&](const auto& map, const plot::ArrayData& xcoord, const plot::ArrayData& ycoord,
+							 const std::pair<double, double>& xrange, const std::pair<double, double>& yrange)
 			{
-				const auto& x = m.mXCoord.GetVector();
-				if (x.size() != xsize) throw InvalidArg("size of x coordinate list and the x size of mat must be the same.");
-				if (m.mYCoord)
+				xsize = map.GetSize(0);
+				ysize = map.GetSize(1);
+				auto make = [&](const auto& getx, const auto& gety)
 				{
-					const auto& y = m.mYCoord.GetVector();
-					if (y.size() != ysize) throw InvalidArg("size of y coordinate list and the y size of mat must be the same.");
-					MakeDataObject(mCanvas, i.mGraph, m.mZMap.GetMatrix(), GetCoordFromVector(x), GetCoordFromVector(y));
+					if (!m.mSparse)
+					{
+						MakeDataObject(mCanvas, i.mGraph, map, getx, gety);
+						return;
+					}
+					if (!std::isnan(m.mSkipValue))
+					{
+						ColormapBackground bg{ getx(0), getx(xsize), gety(0), gety(ysize), getx.center(0), gety.center(0), m.mSkipValue };
+						MakeDataObject(mCanvas, GetColormapBackgroundName(i.mGraph, mCanvas->IsInMemoryDataTransferEnabled()), bg);
+					}
+					MakeDataObject(mCanvas, i.mGraph, map, getx, gety, SkipValue{ m.mSkipValue });
+				};
+				if (xcoord)
+				{
+					auto x = xcoord.GetView();
+					if (ycoord)
+					{
+						auto y = ycoord.GetView();
+						make(GetCoordFromVector(x), GetCoordFromVector(y));
+					}
+					else make(GetCoordFromVector(x), GetCoordFromRange(yrange, ysize));
 				}
 				else
 				{
-					auto y = m.mYRange;
-					MakeDataObject(mCanvas, i.mGraph, m.mZMap.GetMatrix(), GetCoordFromVector(x), GetCoordFromRange(y, ysize));
+					if (ycoord)
+					{
+						auto y = ycoord.GetView();
+						make(GetCoordFromRange(xrange, xsize), GetCoordFromVector(y));
+					}
+					else make(GetCoordFromRange(xrange, xsize), GetCoordFromRange(yrange, ysize));
 				}
-			}
-			else
+			};
+			m.mZMap.VisitView([&](const auto& map)
 			{
-				auto x = m.mXRange;
-				if (m.mYCoord)
+				uint32_t sx = map.GetSize(0);
+				uint32_t sy = map.GetSize(1);
+				if (m.mXCoord && m.mXCoord.GetView().size() != sx)
+					throw InvalidArg("size of x coordinate list and the x size of mat must be the same.");
+				if (m.mYCoord && m.mYCoord.GetView().size() != sy)
+					throw InvalidArg("size of y coordinate list and the y size of mat must be the same.");
+
+				//出力画像の1ピクセルより細かいセルは見えないので、解像度まで並列に縮小してから書き出す。
+				std::pair<int, int> res = mCanvas->GetResolution();
+				uint32_t nx = std::min(sx, (uint32_t)std::max(res.first, 2));
+				uint32_t ny = std::min(sy, (uint32_t)std::max(res.second, 2));
+				if (!m.mDownsample || (nx == sx && ny == sy))
 				{
-					const auto& y = m.mYCoord.GetVector();
-					if (y.size() != ysize) throw InvalidArg("size of y coordinate list and the y size of mat must be the same.");
-					MakeDataObject(mCanvas, i.mGraph, m.mZMap.GetMatrix(), GetCoordFromRange(x, xsize), GetCoordFromVector(y));
+					write(map, m.mXCoord, m.mYCoord, m.mXRange, m.mYRange);
+					return;
 				}
-				else
+				auto small = [&]()
 				{
-					auto y = m.mYRange;
-					MakeDataObject(mCanvas, i.mGraph, m.mZMap.GetMatrix(), GetCoordFromRange(x, xsize), GetCoordFromRange(y, ysize));
-				}
-			}
+					TraceScope trace("Downsample");
+					return Resample(map, nx, ny, m.mDownsampleMethod);
+				}();
+				std::vector<double> xv, yv;
+				plot::ArrayData xcoord, ycoord;
+				std::pair<double, double> xrange = m.mXRange, yrange = m.mYRange;
+				if (m.mXCoord) xcoord = xv = ResampleCoord(m.mXCoord.GetView(), nx, m.mDownsampleMethod);
+				else xrange = ResampleRange(m.mXRange, sx, nx);
+				if (m.mYCoord) ycoord = yv = ResampleCoord(m.mYCoord.GetView(), ny, m.mDownsampleMethod);
+				else yrange = ResampleRange(m.mYRange, sy, ny);
+				write(MakeView(std::as_const(small)), xcoord, ycoord, xrange, yrange);
+			});
 
 			//最後にcontourを作成する。
 			if (m.mWithContour)
@@ -2487,7 +3817,7 @@ PlotVectors(const std::string& filename,
 template <class GraphParam>
 template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 inline GPMPlotBufferCM<GraphParam> GPMPlotBufferCM<GraphParam>::
-PlotColormap(const Matrix<double>& map, const std::vector<double>& x, const std::vector<double>& y,
+PlotColormap(const plot::MatrixData& map, const std::vector<double>& x, const std::vector<double>& y,
 			 Options ...ops)
 {
 	GraphParam i;
@@ -2542,7 +3872,7 @@ PlotColormap(const std::string& equation, Options ...ops)
 template <class GraphParam>
 template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 inline GPMPlotBufferCM<GraphParam> GPMPlotBufferCM<GraphParam>::
-PlotColormap(const Matrix<double>& map, std::pair<double, double> x, std::pair<double, double> y,
+PlotColormap(const plot::MatrixData& map, std::pair<double, double> x, std::pair<double, double> y,
 			 Options ...ops)
 {
 	GraphParam i;
@@ -2558,12 +3888,47 @@ PlotColormap(const Matrix<double>& map, std::pair<double, double> x, std::pair<d
 	m.SetOptions(ops...);
 	return Plot(i);
 }
+template <class GraphParam>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+inline GPMPlotBufferCM<GraphParam> GPMPlotBufferCM<GraphParam>::
+PlotColormap(const plot::MatrixData& map, const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y,
+			 Options ...ops)
+{
+	GraphParam i;
+	i.AssignColormap();
+	i.mType = GraphParam::DATA;
+	i.SetBaseOptions(ops...);
+
+	//map
+	auto& m = i.GetColormapParam();
+	m.mZMap = map;
+	m.mXCoord = x;
+	m.mYCoord = y;
+	m.SetOptions(ops...);
+	return Plot(i);
+}
 
 template <class GraphParam>
 inline std::string GPMPlotBufferCM<GraphParam>::PlotCommand(const GraphParam& p, const bool IsInMemoryDataTransferEnabled)
 {
 	//filename or equation
 	std::string c;
+	//skip_valueを与えたカラーマップでは、背景を別の要素として先に描き、その上にセルを重ねる。
+	//pm3dは要素を並べた順に描くので、背景がセルを覆うことはない。
+	if (p.mType == GraphParam::DATA && p.IsColormap())
+	{
+		auto& m = p.GetColormapParam();
+		if (m.mSparse && !std::isnan(m.mSkipValue))
+		{
+			std::string bg = GetColormapBackgroundName(p.mGraph, IsInMemoryDataTransferEnabled);
+			if (IsInMemoryDataTransferEnabled) c += " " + bg;
+			else c += " '" + bg + "'";
+			c += " using 1:2:5 notitle with pm3d";
+			if (m.mWithoutSurface) c += " nosurface";
+			if (!p.mAxis.empty()) c += " axes " + p.mAxis;
+			c += ",";
+		}
+	}
 	switch (p.mType) 
 	{
 	case GraphParam::EQUATION:
@@ -2655,26 +4020,22 @@ inline std::string GPMPlotBufferCM<GraphParam>::PlotCommand(const GraphParam& p,
 	}
 	return c;
 }
-template <class GraphParam>
-inline std::string GPMPlotBufferCM<GraphParam>::InitCommand()
-{
-	std::string c;
-	c += "set autoscale\n";
-	c += "unset logscale\n";
-	c += "unset title\n";
-	c += "unset grid\n";
-	c += "set size noratio\n";
-	c += "unset pm3d\n";
-	c += "unset contour\n";
-	c += "set surface";
-	return c;
-}
 
 template <class GraphParam, template <class> class Buffer>
 inline GPMCanvasCM<GraphParam, Buffer>::GPMCanvasCM(const std::string& output, double sizex, double sizey)
 	: detail::GPM2DAxis<GPMCanvas>(output, sizex, sizey)
 {
-	if (mPipe)
+	if (mSink)
+	{
+		this->Command("set pm3d corners2color c1");
+		this->Command("set view map");
+	}
+}
+template <class GraphParam, template <class> class Buffer>
+inline GPMCanvasCM<GraphParam, Buffer>::GPMCanvasCM(const std::string& output, std::shared_ptr<GPMCommandSink> sink, double sizex, double sizey)
+	: detail::GPM2DAxis<GPMCanvas>(output, std::move(sink), sizex, sizey)
+{
+	if (mSink)
 	{
 		this->Command("set pm3d corners2color c1");
 		this->Command("set view map");
@@ -2683,7 +4044,7 @@ inline GPMCanvasCM<GraphParam, Buffer>::GPMCanvasCM(const std::string& output, d
 template <class GraphParam, template <class> class Buffer>
 inline GPMCanvasCM<GraphParam, Buffer>::GPMCanvasCM()
 {
-	if (mPipe)
+	if (mSink)
 	{
 		this->Command("set pm3d corners2color c1");
 		this->Command("set view map");
@@ -2826,7 +4187,16 @@ PlotVectors(const std::string& filename,
 template <class GraphParam, template <class> class Buffer>
 template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 Buffer<GraphParam> GPMCanvasCM<GraphParam, Buffer>::
-PlotColormap(const Matrix<double>& map, const std::vector<double>& x, const std::vector<double>& y,
+PlotColormap(const plot::MatrixData& map, const std::vector<double>& x, const std::vector<double>& y,
+			 Options ...ops)
+{
+	_Buffer p(this);
+	return p.PlotColormap(map, x, y, ops...);
+}
+template <class GraphParam, template <class> class Buffer>
+template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
+Buffer<GraphParam> GPMCanvasCM<GraphParam, Buffer>::
+PlotColormap(const plot::MatrixData& map, std::pair<double, double> x, std::pair<double, double> y,
 			 Options ...ops)
 {
 	_Buffer p(this);
@@ -2835,7 +4205,7 @@ PlotColormap(const Matrix<double>& map, const std::vector<double>& x, const std:
 template <class GraphParam, template <class> class Buffer>
 template <class ...Options, bool B, std::enable_if_t<B, std::nullptr_t>>
 Buffer<GraphParam> GPMCanvasCM<GraphParam, Buffer>::
-PlotColormap(const Matrix<double>& map, std::pair<double, double> x, std::pair<double, double> y,
+PlotColormap(const plot::MatrixData& map, const MatrixView<const double, 1>& x, const MatrixView<const double, 1>& y,
 			 Options ...ops)
 {
 	_Buffer p(this);
@@ -2892,16 +4262,12 @@ inline GPMMultiPlot::~GPMMultiPlot()
 }
 inline void GPMMultiPlot::Begin(const std::string& output, int row, int column, double sizex, double sizey)
 {
-	if (GPMCanvas::Paths<>::msGlobalPipe != nullptr)
+	if (GPMCanvas::Paths<>::msGlobalSink != nullptr)
 	{
 		std::cerr << "Gnuplot has already been open. " << GPMCanvas::GetGnuplotPath() << std::endl;
 		return;
 	}
-	if ((GPMCanvas::Paths<>::msGlobalPipe = _popen(GPMCanvas::GetGnuplotPath().c_str(), "w")) == nullptr)
-	{
-		std::cerr << "Gnuplot cannot open. " << GPMCanvas::GetGnuplotPath() << std::endl;
-	}
-	else
+	if ((GPMCanvas::Paths<>::msGlobalSink = GPMCanvas::OpenSink(output)) != nullptr)
 	{
 		Command("set bars small");
 		Command("set palette defined ( 0 '#000090',1 '#000fff',2 '#0090ff',3 '#0fffee',4 '#90ff70',5 '#ffee00',6 '#ff7000',7 '#ee0000',8 '#7f0000')");
@@ -2934,19 +4300,112 @@ inline void GPMMultiPlot::Begin(const std::string& output, int row, int column,
 }
 inline void GPMMultiPlot::End()
 {
-	if (GPMCanvas::Paths<>::msGlobalPipe != nullptr)
+	if (GPMCanvas::Paths<>::msGlobalSink != nullptr)
 	{
 		Command("unset multiplot");
-		_pclose(GPMCanvas::Paths<>::msGlobalPipe);
-		GPMCanvas::Paths<>::msGlobalPipe = nullptr;
+		GPMCanvas::Paths<>::msGlobalSink = nullptr;
 	}
 }
 inline void GPMMultiPlot::Command(const std::string& str)
 {
-	fprintf(GPMCanvas::Paths<>::msGlobalPipe, "%s\n", str.c_str());
-	fflush(GPMCanvas::Paths<>::msGlobalPipe);
+	GPMCanvas::Paths<>::msGlobalSink->Write(str + "\n");
+	GPMCanvas::Paths<>::msGlobalSink->Flush();
+}
+
+// Draws a sequence of frames with one gnuplot session.
+// output is either a GIF file ("anim.gif"), to which every plot is added as a frame of an animated GIF,
+// or a file name with one integer conversion ("frame%04d.png"), which makes one file per frame.
+// Call NextFrame() before plotting each frame, including the first.
+// The canvas lives across frames, so settings repeated every frame are sent only when they change (see SetState),
+// and datablock transfer and datablock reuse are enabled so that data unchanged since the previous frame is not sent again.
+// gnuplot is fed by a background thread (GPMAsyncSink), so the next frame is serialized while gnuplot renders the current one.
+template <class Canvas>
+class GPMAnimation : public Canvas
+{
+public:
+
+	// delay is the time between frames of an animated GIF in 1/100 seconds.
+	// Throws InvalidArg if gnuplot (or the sink selected by SetSinkFactory/SetScriptDirectory) cannot be opened.
+	GPMAnimation(const std::string& output, double sizex = 0., double sizey = 0., int delay = 10);
+
+	void NextFrame();
+	size_t GetNumFrames() const;
+	// Output file of the current frame.
+	const std::string& GetFrameOutput() const;
+
+private:
+
+	static std::shared_ptr<GPMCommandSink> OpenAsyncSink(const std::string& output);
+	//"%d"、"%04d"などの整数の変換指定をindexで置き換える。変換指定がなければpatternをそのまま返す。
+	static std::string GetFrameName(const std::string& pattern, size_t index);
+
+	std::string mPattern;//連番のファイル名の書式。GIFの場合は空。
+	std::string mFrameOutput;
+	size_t mNumFrames;
+};
+
+template <class Canvas>
+inline GPMAnimation<Canvas>::GPMAnimation(const std::string& output, double sizex, double sizey, int delay)
+	: Canvas(GetFrameName(output, 0), OpenAsyncSink(output), sizex, sizey),
+	mFrameOutput(GetFrameName(output, 0)), mNumFrames(0)
+{
+	if (mFrameOutput != output) mPattern = output;
+	else if (output.size() > 4 && output.substr(output.size() - 4, 4) == ".gif")
+	{
+		//SetOutputが選んだ静止画の端末を、アニメーションに切り替える。
+		std::pair<int, int> res = this->GetResolution();
+		this->Command(Format("set terminal gif enhanced animate delay %d size %d, %d\nset output '%s'",
+							 delay, res.first, res.second, ReplaceStr(output, "\\", "/")));
+	}
+	this->EnableInMemoryDataTransfer(true);
+	this->EnableDataBlockReuse(true);
+}
+template <class Canvas>
+inline void GPMAnimation<Canvas>::NextFrame()
+{
+	//最初のフレームの出力先はコンストラクタで設定されている。
+	if (mNumFrames++ == 0 || mPattern.empty()) return;
+	mFrameOutput = GetFrameName(mPattern, mNumFrames - 1);
+	this->Command("set output '" + ReplaceStr(mFrameOutput, "\\", "/") + "'");
+}
+template <class Canvas>
+inline size_t GPMAnimation<Canvas>::GetNumFrames() const
+{
+	return mNumFrames;
+}
+template <class Canvas>
+inline const std::string& GPMAnimation<Canvas>::GetFrameOutput() const
+{
+	return mFrameOutput;
+}
+template <class Canvas>
+inline std::shared_ptr<GPMCommandSink> GPMAnimation<Canvas>::OpenAsyncSink(const std::string& output)
+{
+	//nullptrを返すとCanvasのコンストラクタが既定の出力先をもう一つ開いてしまうので、開けなければ例外を投げる。
+	auto sink = GPMCanvas::OpenSink(output);
+	if (sink == nullptr) throw InvalidArg("command sink for \"" + output + "\" cannot open.");
+	return std::make_shared<GPMAsyncSink>(std::move(sink));
+}
+template <class Canvas>
+inline std::string GPMAnimation<Canvas>::GetFrameName(const std::string& pattern, size_t index)
+{
+	for (size_t pos = pattern.find('%'); pos != std::string::npos; pos = pattern.find('%', pos + 2))
+	{
+		if (pos + 1 < pattern.size() && pattern[pos + 1] == '%') continue;
+		size_t end = pattern.find_first_not_of("0123456789", pos + 1);
+		if (end == std::string::npos || pattern[end] != 'd')
+			throw InvalidArg("output \"" + pattern + "\" has an invalid conversion. Only %d with an optional width is allowed.");
+		int width = end > pos + 1 ? std::stoi(pattern.substr(pos + 1, end - pos - 1)) : 0;
+		std::string num = std::to_string(index);
+		if ((int)num.size() < width) num.insert(0, width - num.size(), pattern[pos + 1] == '0' ? '0' : ' ');
+		return ReplaceStr(pattern.substr(0, pos), "%%", "%") + num + ReplaceStr(pattern.substr(end + 1), "%%", "%");
+	}
+	return ReplaceStr(pattern, "%%", "%");
 }
 
+using GPMAnimation2D = GPMAnimation<GPMCanvas2D>;
+using GPMAnimationCM = GPMAnimation<GPMCanvasCM>;
+
 }
 
 }
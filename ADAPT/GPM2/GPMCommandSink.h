@@ -0,0 +1,573 @@
+#ifndef GPM2_GPMCOMMANDSINK_H
+#define GPM2_GPMCOMMANDSINK_H
+
+#include <cstdio>
+#include <string>
+#include <iostream>
+#include <filesystem>
+#include <vector>
+#include <cstddef>
+#include <cerrno>
+#include <future>
+#include <thread>
+#include <fstream>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include <condition_variable>
+#include <ADAPT/CUF/Function.h>
+#if !defined(_WIN32)
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+namespace adapt
+{
+
+namespace gpm2
+{
+
+// Destination of the command stream produced by GPMCanvas.
+// GPMCanvas formats each command and passes it to Write().
+class GPMCommandSink
+{
+public:
+
+	GPMCommandSink() : mBytes(0) {}
+	GPMCommandSink(const GPMCommandSink&) = delete;
+	GPMCommandSink& operator=(const GPMCommandSink&) = delete;
+	virtual ~GPMCommandSink() = default;
+
+	virtual void Write(const char* str, size_t size) = 0;
+	void Write(const std::string& str) { Write(str.data(), str.size()); }
+	virtual void Flush() {}
+
+	// Name by which the command stream refers to a data file that the canvas would call "name".
+	virtual std::string GetDataFileName(const std::string& name) const { return name; }
+	// Path to which a data file named "name" in the command stream should be written.
+	virtual std::string GetDataFilePath(const std::string& name) const { return name; }
+	// True if the commands are recorded to be loaded later, rather than executed by a running gnuplot.
+	virtual bool IsScript() const { return false; }
+	// False if nothing is written anywhere (e.g. the sink could not be opened).
+	virtual bool IsOpen() const { return true; }
+	// True if the image is taken from gnuplot's stdout instead of being written to the output file.
+	virtual bool CapturesImage() const { return false; }
+	// Called with the contents of each temporary data file the canvas writes, since they are a part of the input
+	// to gnuplot without passing through Write(). Nothing is done by default.
+	virtual void AddFileData(const char* /*str*/, size_t /*size*/) {}
+
+	// Total number of bytes written so far.
+	size_t GetBytes() const { return mBytes; }
+
+protected:
+
+	size_t mBytes;
+};
+
+// Sends the commands to a gnuplot process through a pipe. "exit" is sent on destruction.
+class GPMPipeSink : public GPMCommandSink
+{
+public:
+
+	using GPMCommandSink::Write;
+
+	explicit GPMPipeSink(const std::string& command)
+		: mPipe(_popen(command.c_str(), "w"))
+	{
+		if (mPipe == nullptr) std::cerr << "Gnuplot cannot open. " << command << std::endl;
+	}
+	~GPMPipeSink()
+	{
+		if (mPipe == nullptr) return;
+		fputs("exit\n", mPipe);
+		_pclose(mPipe);
+	}
+
+	virtual void Write(const char* str, size_t size) override
+	{
+		if (mPipe == nullptr) return;
+		fwrite(str, 1, size, mPipe);
+		mBytes += size;
+	}
+	virtual void Flush() override { if (mPipe != nullptr) fflush(mPipe); }
+	virtual bool IsOpen() const override { return mPipe != nullptr; }
+
+private:
+
+	FILE* mPipe;
+};
+
+// Writes the commands to a gnuplot script file. Data files referred to by the script are written
+// relative to datadir, which should be the directory from which the script is loaded.
+class GPMFileSink : public GPMCommandSink
+{
+public:
+
+	using GPMCommandSink::Write;
+
+	GPMFileSink(const std::string& path, const std::string& datadir = "")
+		: mFile(nullptr), mDataDir(datadir)
+	{
+		std::error_code ec;
+		std::filesystem::path p(path);
+		if (p.has_parent_path()) std::filesystem::create_directories(p.parent_path(), ec);
+		if ((mFile = fopen(path.c_str(), "w")) == nullptr) std::cerr << "Script file cannot open. " << path << std::endl;
+	}
+	~GPMFileSink()
+	{
+		//スクリプトは他のスクリプトと続けてloadされるので、exitを書き込まない。
+		if (mFile != nullptr) fclose(mFile);
+	}
+
+	virtual void Write(const char* str, size_t size) override
+	{
+		if (mFile == nullptr) return;
+		fwrite(str, 1, size, mFile);
+		mBytes += size;
+	}
+	virtual void Flush() override { if (mFile != nullptr) fflush(mFile); }
+	virtual std::string GetDataFileName(const std::string& name) const override
+	{
+		//スクリプトはmDataDirで実行されるので、絶対パスはルートを除いてmDataDirからの相対パスとして参照する。
+		if (mDataDir.empty()) return name;
+		return std::filesystem::path(name).relative_path().generic_string();
+	}
+	virtual std::string GetDataFilePath(const std::string& name) const override
+	{
+		if (mDataDir.empty()) return name;
+		return (std::filesystem::path(mDataDir) / GetDataFileName(name)).string();
+	}
+	virtual bool IsScript() const override { return true; }
+	virtual bool IsOpen() const override { return mFile != nullptr; }
+
+private:
+
+	FILE* mFile;
+	std::string mDataDir;
+};
+
+namespace detail
+{
+
+//64ビットのFNV-1aハッシュを逐次計算する。
+class Fnv1a64
+{
+public:
+
+	Fnv1a64() : mHash(14695981039346656037ull) {}
+
+	void Update(const char* str, size_t size)
+	{
+		uint64_t h = mHash;
+		for (size_t i = 0; i < size; ++i)
+		{
+			h ^= (unsigned char)str[i];
+			h *= 1099511628211ull;
+		}
+		mHash = h;
+	}
+	uint64_t Get() const { return mHash; }
+
+private:
+
+	uint64_t mHash;
+};
+
+}
+
+// Render cache. The command stream and the contents of the temporary data files are kept in memory and hashed,
+// and gnuplot is started on destruction only if the output file and its sidecar "<output>.gpm2cache" do not
+// record the same hash. After a successful render the hash is written to the sidecar.
+// Files which are plotted by name (not written by GPM2) are not hashed, so changes to them are not detected.
+class GPMCachedSink : public GPMCommandSink
+{
+public:
+
+	using GPMCommandSink::Write;
+
+	GPMCachedSink(const std::string& output, const std::string& command)
+		: mOutput(output), mCommand(command)
+	{
+		//キャッシュの形式を変えたときに古いsidecarと一致しないよう、版を混ぜておく。
+		static const char version[] = "gpm2-render-cache-1\n";
+		mHash.Update(version, sizeof(version) - 1);
+	}
+	~GPMCachedSink()
+	{
+		namespace fs = std::filesystem;
+		std::string key = GetKey();
+		std::string sidecar = mOutput + ".gpm2cache";
+		std::error_code ec;
+		auto size = fs::file_size(mOutput, ec);
+		if (!ec)
+		{
+			std::ifstream ifs(sidecar);
+			std::string recorded;
+			if (std::getline(ifs, recorded) && recorded == key + " " + std::to_string(size))
+				return;
+		}
+		//描画に失敗したときに古いsidecarが一致したままにならないよう、先に消しておく。
+		fs::remove(sidecar, ec);
+		{
+			GPMPipeSink pipe(mCommand);
+			if (!pipe.IsOpen()) return;
+			pipe.Write(mBuffer);
+		}
+		size = fs::file_size(mOutput, ec);
+		if (!ec) std::ofstream(sidecar) << key << " " << size << "\n";
+	}
+
+	virtual void Write(const char* str, size_t size) override
+	{
+		mBuffer.append(str, size);
+		mHash.Update(str, size);
+		mBytes += size;
+	}
+	virtual void AddFileData(const char* str, size_t size) override
+	{
+		mHash.Update(str, size);
+	}
+
+	// Hash of everything written so far, as 16 hexadecimal digits.
+	std::string GetKey() const
+	{
+		char buf[17];
+		snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)mHash.Get());
+		return buf;
+	}
+
+private:
+
+	std::string mOutput;
+	std::string mCommand;
+	std::string mBuffer;
+	detail::Fnv1a64 mHash;
+};
+
+// Runs gnuplot like GPMPipeSink, and collects the image gnuplot writes to its stdout.
+// A canvas given this sink sets its terminal from the output name, but issues "set output" without a file name.
+// GetImage() returns a handle which becomes ready with the image bytes after gnuplot exits,
+// i.e. after the canvas (and every other owner of the sink) is destroyed.
+class GPMImageSink : public GPMCommandSink
+{
+public:
+
+	using GPMCommandSink::Write;
+	using Image = std::vector<std::byte>;
+
+	explicit GPMImageSink(const std::string& command)
+		: mPipe(nullptr), mFuture(mPromise.get_future().share())
+	{
+		//起動に失敗した場合もここで報告する。
+		Open(command);
+		if (mPipe == nullptr) std::cerr << "Gnuplot cannot open. " << command << std::endl;
+	}
+	~GPMImageSink()
+	{
+		if (mPipe != nullptr)
+		{
+			fputs("exit\n", mPipe);
+#if defined(_WIN32)
+			_pclose(mPipe);
+			std::ifstream ifs(mTmpFile, std::ios::binary);
+			mImage.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+			ifs.close();
+			std::error_code ec;
+			std::filesystem::remove(mTmpFile, ec);
+#else
+			fclose(mPipe);
+			mReader.join();
+			int status;
+			waitpid(mPid, &status, 0);
+#endif
+		}
+		mPromise.set_value(std::move(mImage));
+	}
+
+	virtual void Write(const char* str, size_t size) override
+	{
+		if (mPipe == nullptr) return;
+		fwrite(str, 1, size, mPipe);
+		mBytes += size;
+	}
+	virtual void Flush() override { if (mPipe != nullptr) fflush(mPipe); }
+	virtual bool IsOpen() const override { return mPipe != nullptr; }
+	virtual bool CapturesImage() const override { return true; }
+
+	// Completion handle of the image. The image is empty if gnuplot could not be started.
+	std::shared_future<Image> GetImage() const { return mFuture; }
+
+private:
+
+	//gnuplotを起動してmPipeを開く。失敗した場合はmPipeがnullptrのまま戻る。
+	void Open(const std::string& command)
+	{
+#if defined(_WIN32)
+		//Windowsでは双方向のパイプを簡単に作れないので、標準出力を一時ファイルに受けてから読み込む。
+		mTmpFile = (std::filesystem::temp_directory_path() / ("gpm2_image_" + std::to_string((uintptr_t)this) + ".tmp")).string();
+		mPipe = _popen((command + " > \"" + mTmpFile + "\"").c_str(), "w");
+#else
+		int in[2], out[2];
+		if (pipe(in) != 0) return;
+		if (pipe(out) != 0)
+		{
+			close(in[0]); close(in[1]);
+			return;
+		}
+		//他のGPMImageSinkが起動するgnuplotにこのパイプが引き継がれると、子が終了するまでEOFが届かなくなる。
+		//dup2で複製した0、1番はclose-on-execが外れるので、このgnuplot自身には影響しない。
+		for (int fd : { in[0], in[1], out[0], out[1] }) fcntl(fd, F_SETFD, FD_CLOEXEC);
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, in[0], 0);
+		posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+		posix_spawn_file_actions_addclose(&actions, in[0]);
+		posix_spawn_file_actions_addclose(&actions, in[1]);
+		posix_spawn_file_actions_addclose(&actions, out[0]);
+		posix_spawn_file_actions_addclose(&actions, out[1]);
+		const char* argv[] = { "sh", "-c", command.c_str(), nullptr };
+		int res = posix_spawn(&mPid, "/bin/sh", &actions, nullptr, const_cast<char**>(argv), environ);
+		posix_spawn_file_actions_destroy(&actions);
+		close(in[0]);
+		close(out[1]);
+		if (res != 0)
+		{
+			close(in[1]);
+			close(out[0]);
+			return;
+		}
+		mPipe = fdopen(in[1], "w");
+		if (mPipe == nullptr)
+		{
+			//gnuplotは標準入力が閉じられると終了する。
+			close(in[1]);
+			close(out[0]);
+			int status;
+			waitpid(mPid, &status, 0);
+			return;
+		}
+		//gnuplotが標準出力への書き込みで詰まらないよう、別スレッドで読み続ける。
+		int fd = out[0];
+		mReader = std::thread([this, fd]()
+		{
+			char buf[1 << 16];
+			ssize_t n;
+			while ((n = read(fd, buf, sizeof(buf))) != 0)
+			{
+				if (n < 0)
+				{
+					if (errno == EINTR) continue;
+					break;
+				}
+				const std::byte* b = reinterpret_cast<const std::byte*>(buf);
+				mImage.insert(mImage.end(), b, b + n);
+			}
+			close(fd);
+		});
+#endif
+	}
+
+	FILE* mPipe;
+	Image mImage;
+	std::promise<Image> mPromise;
+	std::shared_future<Image> mFuture;
+#if defined(_WIN32)
+	std::string mTmpFile;
+#else
+	pid_t mPid;
+	std::thread mReader;
+#endif
+};
+
+// Passes the commands to another sink on a background thread, so that the caller can go on formatting
+// (e.g. the next frame of an animation) while the other sink is blocked by a busy gnuplot.
+// At most maxpending bytes are queued; Write() waits while the queue is full.
+// An exception thrown by the other sink is rethrown from the next Write(), Flush() or AddFileData(),
+// and later commands are discarded. If none of them is called again, the destructor reports it to std::cerr.
+class GPMAsyncSink : public GPMCommandSink
+{
+public:
+
+	using GPMCommandSink::Write;
+
+	explicit GPMAsyncSink(std::shared_ptr<GPMCommandSink> sink, size_t maxpending = (size_t)64 << 20)
+		: mSink(std::move(sink)), mMaxPending(maxpending), mPending(0), mDone(false), mFailed(false)
+	{
+		mChunk.reserve(msChunkSize);
+		mThread = std::thread([this]() { Run(); });
+	}
+	~GPMAsyncSink()
+	{
+		Push(STREAM, std::move(mChunk));
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mDone = true;
+		}
+		mNotEmpty.notify_one();
+		mThread.join();
+		//デストラクタからは投げられないので、まだ伝えていない例外は表示するだけにする。
+		if (mError)
+		{
+			try { std::rethrow_exception(mError); }
+			catch (const std::exception& e) { std::cerr << "Commands could not be passed to the sink. " << e.what() << std::endl; }
+			catch (...) { std::cerr << "Commands could not be passed to the sink." << std::endl; }
+		}
+	}
+
+	virtual void Write(const char* str, size_t size) override
+	{
+		if (mFailed.load(std::memory_order_relaxed)) RethrowError();
+		mChunk.append(str, size);
+		mBytes += size;
+		if (mChunk.size() >= msChunkSize) Push(STREAM, std::move(mChunk));
+	}
+	virtual void Flush() override
+	{
+		if (mFailed.load(std::memory_order_relaxed)) RethrowError();
+		Push(STREAM, std::move(mChunk));
+		Push(FLUSH, std::string());
+	}
+	virtual std::string GetDataFileName(const std::string& name) const override { return mSink->GetDataFileName(name); }
+	virtual std::string GetDataFilePath(const std::string& name) const override { return mSink->GetDataFilePath(name); }
+	virtual bool IsScript() const override { return mSink->IsScript(); }
+	virtual bool IsOpen() const override { return mSink->IsOpen(); }
+	virtual bool CapturesImage() const override { return mSink->CapturesImage(); }
+	virtual void AddFileData(const char* str, size_t size) override
+	{
+		//コマンドとの順序を保つため、これもキューを通して渡す。
+		if (mFailed.load(std::memory_order_relaxed)) RethrowError();
+		Push(STREAM, std::move(mChunk));
+		Push(FILEDATA, std::string(str, size));
+	}
+
+private:
+
+	enum Kind { STREAM, FILEDATA, FLUSH, };
+	struct Item
+	{
+		Kind mKind;
+		std::string mData;
+	};
+
+	void Push(Kind kind, std::string&& data)
+	{
+		if (kind != FLUSH && data.empty()) return;
+		size_t size = data.size();
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mNotFull.wait(lock, [&]() { return mPending == 0 || mPending + size <= mMaxPending; });
+			mPending += size;
+			mQueue.push_back(Item{ kind, std::move(data) });
+		}
+		mNotEmpty.notify_one();
+		mChunk.clear();
+		mChunk.reserve(msChunkSize);
+	}
+	void Run()
+	{
+		while (true)
+		{
+			Item item;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mNotEmpty.wait(lock, [&]() { return mDone || !mQueue.empty(); });
+				if (mQueue.empty()) return;
+				item = std::move(mQueue.front());
+				mQueue.pop_front();
+			}
+			//例外がこのスレッドから漏れるとstd::terminateになるので、記録して呼び出し側のスレッドで投げ直す。
+			//一度失敗した後の項目は、待っているPushを進めるために捨てる。
+			if (!mFailed.load(std::memory_order_relaxed))
+			{
+				try
+				{
+					if (item.mKind == STREAM) mSink->Write(item.mData);
+					else if (item.mKind == FILEDATA) mSink->AddFileData(item.mData.data(), item.mData.size());
+					else mSink->Flush();
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mError = std::current_exception();
+					mFailed.store(true, std::memory_order_relaxed);
+				}
+			}
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mPending -= item.mData.size();
+			}
+			mNotFull.notify_one();
+		}
+	}
+
+	//Runで記録された例外を一度だけ投げ直す。
+	void RethrowError()
+	{
+		std::exception_ptr e;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			std::swap(e, mError);
+		}
+		if (e) std::rethrow_exception(e);
+	}
+
+	static constexpr size_t msChunkSize = 1 << 16;
+	std::shared_ptr<GPMCommandSink> mSink;
+	std::string mChunk;
+	std::deque<Item> mQueue;
+	size_t mMaxPending;
+	size_t mPending;
+	bool mDone;
+	std::atomic<bool> mFailed;
+	std::exception_ptr mError;
+	std::mutex mMutex;
+	std::condition_variable mNotEmpty;
+	std::condition_variable mNotFull;
+	std::thread mThread;
+};
+
+// Keeps the whole command stream in memory. Useful for tests and for measuring serialization alone.
+class GPMMemorySink : public GPMCommandSink
+{
+public:
+
+	using GPMCommandSink::Write;
+
+	virtual void Write(const char* str, size_t size) override
+	{
+		mBuffer.append(str, size);
+		mBytes += size;
+	}
+
+	const std::string& GetString() const { return mBuffer; }
+	void Clear() { mBuffer.clear(); }
+
+private:
+
+	std::string mBuffer;
+};
+
+// Discards the commands and only counts their size.
+class GPMNullSink : public GPMCommandSink
+{
+public:
+
+	using GPMCommandSink::Write;
+
+	virtual void Write(const char*, size_t size) override
+	{
+		mBytes += size;
+	}
+};
+
+}
+
+}
+
+#endif
@@ -0,0 +1,485 @@
+#ifndef GPM2_GPMFIT_H
+#define GPM2_GPMFIT_H
+
+#include <ADAPT/CUF/Parallel.h>
+#include <ADAPT/CUF/Exception.h>
+#include <ADAPT/CUF/Format.h>
+#include <ADAPT/CUF/KeywordArgs.h>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+
+namespace adapt
+{
+
+namespace gpm2
+{
+
+namespace fit
+{
+
+struct FitOption {};
+
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(yerrorbar, const std::vector<double>&, FitOption)//各点のyの標準偏差。1/yerrorbar^2で重み付けされる。
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(maxiter, int, FitOption)//非線形フィットの最大反復回数。
+CUF_DEFINE_TAGGED_KEYWORD_OPTION_WITH_VALUE(tolerance, double, FitOption)//chi^2の相対変化がこれを下回れば収束とみなす。gnuplotのFIT_LIMITに相当。
+
+}
+
+namespace detail
+{
+
+//式中の識別子のうちparamsに含まれるものを、valuesの値で置き換える。
+//数値リテラル（1e-5など）の中の文字は識別子として扱わない。
+inline std::string SubstituteParameters(const std::string& expression,
+										const std::vector<std::string>& params, const std::vector<double>& values)
+{
+	std::string res;
+	size_t i = 0;
+	while (i < expression.size())
+	{
+		char c = expression[i];
+		if (std::isdigit((unsigned char)c) || (c == '.' && i + 1 < expression.size() && std::isdigit((unsigned char)expression[i + 1])))
+		{
+			size_t j = i;
+			while (j < expression.size() && (std::isdigit((unsigned char)expression[j]) || expression[j] == '.')) ++j;
+			if (j < expression.size() && (expression[j] == 'e' || expression[j] == 'E'))
+			{
+				size_t k = j + 1;
+				if (k < expression.size() && (expression[k] == '+' || expression[k] == '-')) ++k;
+				if (k < expression.size() && std::isdigit((unsigned char)expression[k]))
+				{
+					j = k;
+					while (j < expression.size() && std::isdigit((unsigned char)expression[j])) ++j;
+				}
+			}
+			res.append(expression, i, j - i);
+			i = j;
+		}
+		else if (std::isalpha((unsigned char)c) || c == '_')
+		{
+			size_t j = i;
+			while (j < expression.size() && (std::isalnum((unsigned char)expression[j]) || expression[j] == '_')) ++j;
+			std::string name = expression.substr(i, j - i);
+			auto it = std::find(params.begin(), params.end(), name);
+			if (it != params.end())
+			{
+				//値が変わらないよう有効数字17桁で書き出す。
+				res += Format("(%.17g)", values[it - params.begin()]);
+			}
+			else res += name;
+			i = j;
+		}
+		else
+		{
+			res += c;
+			++i;
+		}
+	}
+	return res;
+}
+
+//対称正定値行列a（n x n、行優先）をCholesky分解し、a x = bを解く。aとbは上書きされる。
+//対角成分で規格化してから分解するので、列のスケールが大きく異なる場合にも比較的安定である。
+inline void SolveSymmetric(std::vector<double>& a, std::vector<double>& b, size_t n)
+{
+	std::vector<double> s(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (!(a[i * n + i] > 0.)) throw InvalidValue("the normal matrix of the fit is singular.");
+		s[i] = 1. / std::sqrt(a[i * n + i]);
+	}
+	for (size_t i = 0; i < n; ++i)
+	{
+		for (size_t j = 0; j < n; ++j) a[i * n + j] *= s[i] * s[j];
+		b[i] *= s[i];
+	}
+	for (size_t j = 0; j < n; ++j)
+	{
+		double d = a[j * n + j];
+		for (size_t k = 0; k < j; ++k) d -= a[j * n + k] * a[j * n + k];
+		if (!(d > 1e-14)) throw InvalidValue("the normal matrix of the fit is singular.");
+		d = std::sqrt(d);
+		a[j * n + j] = d;
+		for (size_t i = j + 1; i < n; ++i)
+		{
+			double v = a[i * n + j];
+			for (size_t k = 0; k < j; ++k) v -= a[i * n + k] * a[j * n + k];
+			a[i * n + j] = v / d;
+		}
+	}
+	for (size_t i = 0; i < n; ++i)
+	{
+		double v = b[i];
+		for (size_t k = 0; k < i; ++k) v -= a[i * n + k] * b[k];
+		b[i] = v / a[i * n + i];
+	}
+	for (size_t i = n; i-- > 0;)
+	{
+		double v = b[i];
+		for (size_t k = i + 1; k < n; ++k) v -= a[k * n + i] * b[k];
+		b[i] = v / a[i * n + i];
+	}
+	for (size_t i = 0; i < n; ++i) b[i] *= s[i];
+}
+//対称正定値行列aの逆行列を返す。
+inline std::vector<double> InvertSymmetric(const std::vector<double>& a, size_t n)
+{
+	std::vector<double> inv(n * n);
+	for (size_t j = 0; j < n; ++j)
+	{
+		std::vector<double> m = a;
+		std::vector<double> e(n, 0.);
+		e[j] = 1.;
+		SolveSymmetric(m, e, n);
+		for (size_t i = 0; i < n; ++i) inv[i * n + j] = e[i];
+	}
+	return inv;
+}
+
+//スレッドごとに持つ正規方程式の部分和。
+struct NormalEquation
+{
+	NormalEquation(size_t n) : mJTJ(n * n, 0.), mJTr(n, 0.), mChiSquare(0.), mCount(0) {}
+	void Merge(const NormalEquation& o)
+	{
+		for (size_t i = 0; i < mJTJ.size(); ++i) mJTJ[i] += o.mJTJ[i];
+		for (size_t i = 0; i < mJTr.size(); ++i) mJTr[i] += o.mJTr[i];
+		mChiSquare += o.mChiSquare;
+		mCount += o.mCount;
+	}
+	std::vector<double> mJTJ;
+	std::vector<double> mJTr;
+	double mChiSquare;
+	size_t mCount;
+};
+
+}
+
+//フィットの結果。
+class GPMFitResult
+{
+public:
+
+	GPMFitResult() : mChiSquare(0), mNDF(0), mIterations(0), mConverged(false) {}
+
+	const std::vector<std::string>& GetParameterNames() const { return mNames; }
+	const std::vector<double>& GetParameters() const { return mParams; }
+	double GetParameter(const std::string& name) const { return mParams[GetIndex(name)]; }
+	//gnuplotのfitと同様に、sqrt(chi^2/ndf)でスケールした漸近標準誤差。
+	const std::vector<double>& GetErrors() const { return mErrors; }
+	double GetError(const std::string& name) const { return mErrors[GetIndex(name)]; }
+	//パラメータの分散共分散行列（chi^2/ndfでスケール済み）。
+	double GetCovariance(size_t i, size_t j) const { return mCovariance[i * mParams.size() + j]; }
+	double GetChiSquare() const { return mChiSquare; }
+	size_t GetNDF() const { return mNDF; }
+	double GetReducedChiSquare() const { return mNDF > 0 ? mChiSquare / (double)mNDF : 0.; }
+	int GetIterations() const { return mIterations; }
+	//chi^2の相対的な減少がtolerance以下になって反復を終えた場合にtrue。
+	//maxiterに達した場合や、chi^2を減少させるステップが見つからずに打ち切った場合はfalse。
+	bool IsConverged() const { return mConverged; }
+
+	//パラメータを数値に置き換えたgnuplotの式を返す。PlotLines(equation)にそのまま渡せる。
+	std::string GetEquation() const { return detail::SubstituteParameters(mExpression, mNames, mParams); }
+	//フィットしたモデルをC++側で評価する。
+	double operator()(double x) const { return mFunction(x, mParams.data()); }
+
+private:
+
+	size_t GetIndex(const std::string& name) const
+	{
+		auto it = std::find(mNames.begin(), mNames.end(), name);
+		if (it == mNames.end()) throw InvalidArg("parameter \"" + name + "\" does not exist.");
+		return (size_t)(it - mNames.begin());
+	}
+
+	template <class Model, class ...Options>
+	friend GPMFitResult FitModel(const Model& m, const std::vector<double>& x, const std::vector<double>& y,
+								 std::vector<double> init, Options ...ops);
+
+	std::vector<std::string> mNames;
+	std::vector<double> mParams;
+	std::vector<double> mErrors;
+	std::vector<double> mCovariance;
+	double mChiSquare;
+	size_t mNDF;
+	int mIterations;
+	bool mConverged;
+	std::string mExpression;
+	std::function<double(double, const double*)> mFunction;
+};
+
+//y = a_0 f_0(x) + a_1 f_1(x) + ... の形の線形モデル。
+class GPMLinearModel
+{
+public:
+
+	GPMLinearModel() = default;
+
+	//基底関数fと、それに相当するgnuplotの式を追加する。式中の独立変数はxで表す。
+	//nameはパラメータ名で、空ならa0、a1、...と名付けられる。
+	GPMLinearModel& AddTerm(std::function<double(double)> f, const std::string& expression, const std::string& name = "")
+	{
+		mNames.push_back(name.empty() ? Format("a%zu", mTerms.size()) : name);
+		mTerms.push_back(std::move(f));
+		mExpressions.push_back(expression);
+		return *this;
+	}
+	//a0 + a1*x + ... + an*x**nの多項式モデルを作る。
+	static GPMLinearModel Polynomial(int degree)
+	{
+		if (degree < 0) throw InvalidArg("degree of the polynomial must be non-negative.");
+		GPMLinearModel m;
+		m.AddTerm([](double) { return 1.; }, "1");
+		if (degree >= 1) m.AddTerm([](double x) { return x; }, "x");
+		for (int d = 2; d <= degree; ++d) m.AddTerm([d](double x) { return std::pow(x, d); }, Format("x**%d", d));
+		return m;
+	}
+
+	size_t GetNumParameters() const { return mTerms.size(); }
+	const std::vector<std::string>& GetParameterNames() const { return mNames; }
+	std::string GetExpression() const
+	{
+		std::string res;
+		for (size_t i = 0; i < mTerms.size(); ++i)
+		{
+			if (i != 0) res += "+";
+			res += mNames[i] + "*(" + mExpressions[i] + ")";
+		}
+		return res;
+	}
+	double Evaluate(double x, const double* a) const
+	{
+		double res = 0.;
+		for (size_t i = 0; i < mTerms.size(); ++i) res += a[i] * mTerms[i](x);
+		return res;
+	}
+	void Gradient(double x, const double*, double* grad, double*) const
+	{
+		for (size_t i = 0; i < mTerms.size(); ++i) grad[i] = mTerms[i](x);
+	}
+	static constexpr bool IsLinear() { return true; }
+
+private:
+
+	std::vector<std::function<double(double)>> mTerms;
+	std::vector<std::string> mExpressions;
+	std::vector<std::string> mNames;
+};
+
+//y = f(x; a)の形の非線形モデル。
+class GPMNonlinearModel
+{
+public:
+
+	using Function = std::function<double(double, const double*)>;
+	using GradientFunction = std::function<void(double, const double*, double*)>;
+
+	//fはx、パラメータ配列を受け取ってモデルの値を返す。
+	//expressionはfと同じ関数を表すgnuplotの式で、parametersはその中で使われるパラメータ名の並び（fの引数の順）。
+	GPMNonlinearModel(Function f, const std::string& expression, std::vector<std::string> parameters)
+		: mFunction(std::move(f)), mExpression(expression), mNames(std::move(parameters))
+	{}
+
+	//パラメータによる偏微分を与える。与えなければ前進差分で近似する。
+	GPMNonlinearModel& SetGradient(GradientFunction g) { mGradient = std::move(g); return *this; }
+
+	size_t GetNumParameters() const { return mNames.size(); }
+	const std::vector<std::string>& GetParameterNames() const { return mNames; }
+	const std::string& GetExpression() const { return mExpression; }
+	double Evaluate(double x, const double* a) const { return mFunction(x, a); }
+	//scratchはパラメータ数以上の大きさの作業領域で、差分近似に用いる。呼び出し側がスレッドごとに用意する。
+	void Gradient(double x, const double* a, double* grad, double* scratch) const
+	{
+		if (mGradient)
+		{
+			mGradient(x, a, grad);
+			return;
+		}
+		size_t n = mNames.size();
+		double* b = scratch;
+		std::copy(a, a + n, b);
+		double f0 = mFunction(x, a);
+		for (size_t i = 0; i < n; ++i)
+		{
+			double h = 1e-7 * std::max(std::abs(a[i]), 1e-3);
+			b[i] = a[i] + h;
+			grad[i] = (mFunction(x, b) - f0) / h;
+			b[i] = a[i];
+		}
+	}
+	static constexpr bool IsLinear() { return false; }
+
+private:
+
+	Function mFunction;
+	GradientFunction mGradient;
+	std::string mExpression;
+	std::vector<std::string> mNames;
+};
+
+namespace detail
+{
+
+//パラメータaにおける正規方程式J^T W J、J^T W r、chi^2を、データを分割して並列に積算する。
+//needjacobianがfalseならchi^2のみを計算する。
+template <class Model>
+NormalEquation AccumulateNormalEquation(const Model& m, const std::vector<double>& x, const std::vector<double>& y,
+										const std::vector<double>* yerr, const std::vector<double>& a, bool needjacobian)
+{
+	size_t n = a.size();
+	std::vector<NormalEquation> partial(GetNumThreads(), NormalEquation(n));
+	ParallelFor(0, x.size(), [&](size_t b, size_t e, size_t t)
+	{
+		NormalEquation& ne = partial[t];
+		std::vector<double> grad(n), scratch(n);
+		for (size_t i = b; i < e; ++i)
+		{
+			if (!std::isfinite(x[i]) || !std::isfinite(y[i])) continue;
+			double w = 1.;
+			if (yerr)
+			{
+				double s = (*yerr)[i];
+				if (!(s > 0.)) throw InvalidArg("yerrorbar must be positive.");
+				w = 1. / (s * s);
+			}
+			double r = y[i] - m.Evaluate(x[i], a.data());
+			ne.mChiSquare += w * r * r;
+			++ne.mCount;
+			if (!needjacobian) continue;
+			m.Gradient(x[i], a.data(), grad.data(), scratch.data());
+			for (size_t j = 0; j < n; ++j)
+			{
+				double wg = w * grad[j];
+				ne.mJTr[j] += wg * r;
+				for (size_t k = 0; k <= j; ++k) ne.mJTJ[j * n + k] += wg * grad[k];
+			}
+		}
+	}, 1024);
+	for (size_t t = 1; t < partial.size(); ++t) partial[0].Merge(partial[t]);
+	NormalEquation& res = partial[0];
+	for (size_t j = 0; j < n; ++j)
+		for (size_t k = j + 1; k < n; ++k) res.mJTJ[j * n + k] = res.mJTJ[k * n + j];
+	return std::move(res);
+}
+
+}
+
+//x、yに対してモデルmを最小二乗フィットする。
+//線形モデルなら正規方程式を一度解き、非線形モデルならinitを初期値としてLevenberg-Marquardt法で反復する。
+//残差とヤコビアンの評価はデータを分割して並列に行われる。x、yのいずれかが有限でない点は無視される。
+//options : fit::yerrorbar, fit::maxiter, fit::tolerance
+template <class Model, class ...Options>
+GPMFitResult FitModel(const Model& m, const std::vector<double>& x, const std::vector<double>& y,
+					  std::vector<double> init, Options ...ops)
+{
+	size_t n = m.GetNumParameters();
+	if (n == 0) throw InvalidArg("the model has no parameters.");
+	if (x.size() != y.size()) throw InvalidArg("The number of y does not match with the others.");
+	if (init.empty()) init.assign(n, 1.);
+	if (init.size() != n) throw InvalidArg("the number of initial values does not match with the number of parameters.");
+	//yerrorbarが与えられていない場合、GetKeywordArgは既定値の空の配列を値で返すので、参照で受けて寿命を延ばす。
+	const std::vector<double>& yerrarg = GetKeywordArg(fit::yerrorbar, ops..., std::vector<double>{});
+	const std::vector<double>* yerr = KeywordExists(fit::yerrorbar, ops...) ? &yerrarg : nullptr;
+	if (yerr && yerr->size() != x.size()) throw InvalidArg("The number of yerrorbar does not match with the others.");
+	int maxiter = GetKeywordArg(fit::maxiter, ops..., 100);
+	double tolerance = GetKeywordArg(fit::tolerance, ops..., 1e-5);
+
+	GPMFitResult res;
+	res.mNames = m.GetParameterNames();
+	res.mExpression = m.GetExpression();
+	res.mFunction = [m](double xx, const double* a) { return m.Evaluate(xx, a); };
+
+	std::vector<double> a = std::move(init);
+	detail::NormalEquation ne = detail::AccumulateNormalEquation(m, x, y, yerr, a, true);
+	if (ne.mCount <= n) throw InvalidArg("the number of data points must be larger than the number of parameters.");
+
+	if (Model::IsLinear())
+	{
+		//線形モデルではa + deltaが解となる。
+		std::vector<double> jtj = ne.mJTJ;
+		std::vector<double> delta = ne.mJTr;
+		detail::SolveSymmetric(jtj, delta, n);
+		for (size_t j = 0; j < n; ++j) a[j] += delta[j];
+		ne = detail::AccumulateNormalEquation(m, x, y, yerr, a, true);
+		res.mIterations = 1;
+		res.mConverged = true;
+	}
+	else
+	{
+		double lambda = 1e-3;
+		for (res.mIterations = 1; res.mIterations <= maxiter; ++res.mIterations)
+		{
+			//chi^2が減少するまでlambdaを大きくしながら試行する。
+			bool accepted = false;
+			double prev = ne.mChiSquare;
+			while (lambda < 1e16)
+			{
+				std::vector<double> jtj = ne.mJTJ;
+				std::vector<double> delta = ne.mJTr;
+				for (size_t j = 0; j < n; ++j) jtj[j * n + j] *= 1. + lambda;
+				try { detail::SolveSymmetric(jtj, delta, n); }
+				catch (InvalidValue&) { lambda *= 10.; continue; }
+				std::vector<double> trial = a;
+				for (size_t j = 0; j < n; ++j) trial[j] += delta[j];
+				detail::NormalEquation tne = detail::AccumulateNormalEquation(m, x, y, yerr, trial, false);
+				if (std::isfinite(tne.mChiSquare) && tne.mChiSquare <= ne.mChiSquare)
+				{
+					a = std::move(trial);
+					ne = detail::AccumulateNormalEquation(m, x, y, yerr, a, true);
+					lambda = std::max(lambda * 0.1, 1e-12);
+					accepted = true;
+					break;
+				}
+				lambda *= 10.;
+			}
+			//lambdaを上限まで大きくしてもchi^2が減少しなければ、収束していないものとして打ち切る。
+			if (!accepted) break;
+			if (prev - ne.mChiSquare <= tolerance * ne.mChiSquare)
+			{
+				res.mConverged = true;
+				break;
+			}
+		}
+		if (res.mIterations > maxiter) res.mIterations = maxiter;
+	}
+
+	res.mParams = a;
+	res.mChiSquare = ne.mChiSquare;
+	res.mNDF = ne.mCount - n;
+	double scale = res.mNDF > 0 ? res.mChiSquare / (double)res.mNDF : 1.;
+	res.mCovariance = detail::InvertSymmetric(ne.mJTJ, n);
+	for (auto& c : res.mCovariance) c *= scale;
+	res.mErrors.resize(n);
+	for (size_t j = 0; j < n; ++j) res.mErrors[j] = std::sqrt(res.mCovariance[j * n + j]);
+	return res;
+}
+
+//線形モデルのフィット。
+template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, fit::FitOption)>
+GPMFitResult FitLinear(const std::vector<double>& x, const std::vector<double>& y, const GPMLinearModel& m, Options ...ops)
+{
+	return FitModel(m, x, y, std::vector<double>(m.GetNumParameters(), 0.), ops...);
+}
+//degree次の多項式によるフィット。パラメータ名はa0, a1, ...となる。
+template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, fit::FitOption)>
+GPMFitResult FitPolynomial(const std::vector<double>& x, const std::vector<double>& y, int degree, Options ...ops)
+{
+	return FitLinear(x, y, GPMLinearModel::Polynomial(degree), ops...);
+}
+//非線形モデルのフィット。initはパラメータの初期値。
+template <class ...Options, CUF_TAGGED_ARGS_ENABLER(Options, fit::FitOption)>
+GPMFitResult FitNonlinear(const std::vector<double>& x, const std::vector<double>& y, const GPMNonlinearModel& m,
+						  const std::vector<double>& init, Options ...ops)
+{
+	return FitModel(m, x, y, init, ops...);
+}
+
+}
+
+}
+
+#endif
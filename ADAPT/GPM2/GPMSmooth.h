@@ -0,0 +1,355 @@
+#ifndef GPM2_GPMSMOOTH_H
+#define GPM2_GPMSMOOTH_H
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <ADAPT/CUF/Parallel.h>
+#include <ADAPT/CUF/Exception.h>
+
+namespace adapt
+{
+
+namespace gpm2
+{
+
+namespace detail
+{
+
+//gnuplotのsmoothオプションをC++側で計算するための関数群。
+//いずれもx昇順に並んだ点列を扱う。wはacsplinesの重みで、他の平滑化では使われない。
+
+struct SmoothPoint
+{
+	double x;
+	double y;
+	double w;
+};
+using SmoothPoints = std::vector<SmoothPoint>;
+
+//x、y（、重みw）を組にする。x、y、wのいずれかが有限でない点はgnuplot同様に無視する。
+inline SmoothPoints MakePoints(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>* w = nullptr)
+{
+	if (x.size() != y.size()) throw InvalidArg("The number of y does not match with the others.");
+	if (w && w->size() != x.size()) throw InvalidArg("The number of weights does not match with the others.");
+	SmoothPoints p;
+	p.reserve(x.size());
+	for (size_t i = 0; i < x.size(); ++i)
+	{
+		double wi = w ? (*w)[i] : 1.;
+		if (std::isfinite(x[i]) && std::isfinite(y[i]) && std::isfinite(wi)) p.push_back({ x[i], y[i], wi });
+	}
+	return p;
+}
+//MakePointsで組にした後、xの昇順に並列ソートする。
+inline SmoothPoints SortPoints(const std::vector<double>& x, const std::vector<double>& y, const std::vector<double>* w = nullptr)
+{
+	SmoothPoints p = MakePoints(x, y, w);
+	ParallelSort(p.begin(), p.end(), [](const SmoothPoint& a, const SmoothPoint& b) { return a.x < b.x; });
+	return p;
+}
+
+//ソート済みの点列について、同じxを持つ点の連なりを一つにまとめる。
+//averageがtrueならyの平均（smooth unique）、falseなら和（smooth frequency）を取る。重みは和を取る。
+inline void ImplodePoints(SmoothPoints& p, bool average)
+{
+	if (p.empty()) return;
+	size_t out = 0;
+	size_t count = 1;
+	for (size_t i = 1; i < p.size(); ++i)
+	{
+		if (p[i].x == p[out].x)
+		{
+			p[out].y += p[i].y;
+			p[out].w += p[i].w;
+			++count;
+		}
+		else
+		{
+			if (average) p[out].y /= (double)count;
+			p[++out] = p[i];
+			count = 1;
+		}
+	}
+	if (average) p[out].y /= (double)count;
+	p.resize(out + 1);
+}
+
+//yをそれまでの累積和で置き換える（smooth cumulative）。normalizeがtrueなら最後の値が1になるよう規格化する（smooth cnormal）。
+inline void AccumulatePoints(SmoothPoints& p, bool normalize)
+{
+	double sum = 0.;
+	for (auto& q : p) q.y = (sum += q.y);
+	if (normalize && sum != 0.)
+	{
+		for (auto& q : p) q.y /= sum;
+	}
+}
+
+//折れ線pを、各点から近似折れ線までの縦方向の誤差がtolerance以下になるよう間引く。
+//誤差最大の点で区間を分割していくDouglas-Peucker法を、誤差の大きい区間から優先的に処理する。
+//節点数はmaxknotsを超えない。戻り値は採用された点のインデックスで、昇順に並ぶ。
+inline std::vector<size_t> SelectKnots(const SmoothPoints& p, double tolerance, size_t maxknots)
+{
+	std::vector<size_t> knots;
+	if (p.size() <= 2)
+	{
+		knots.resize(p.size());
+		for (size_t i = 0; i < p.size(); ++i) knots[i] = i;
+		return knots;
+	}
+	struct Segment
+	{
+		double error;
+		size_t begin;
+		size_t end;
+		size_t worst;
+		bool operator<(const Segment& s) const { return error < s.error; }
+	};
+	auto make_segment = [&p](size_t b, size_t e)
+	{
+		Segment s{ 0., b, e, b };
+		double x0 = p[b].x, y0 = p[b].y;
+		double dx = p[e].x - x0;
+		double slope = dx != 0. ? (p[e].y - y0) / dx : 0.;
+		for (size_t i = b + 1; i < e; ++i)
+		{
+			double err = std::abs(p[i].y - (y0 + slope * (p[i].x - x0)));
+			if (err > s.error) s.error = err, s.worst = i;
+		}
+		return s;
+	};
+	std::vector<char> used(p.size(), 0);
+	used.front() = used.back() = 1;
+	size_t nknots = 2;
+	std::priority_queue<Segment> queue;
+	queue.push(make_segment(0, p.size() - 1));
+	while (!queue.empty() && nknots < maxknots)
+	{
+		Segment s = queue.top();
+		if (s.error <= tolerance) break;
+		queue.pop();
+		used[s.worst] = 1;
+		++nknots;
+		if (s.worst - s.begin > 1) queue.push(make_segment(s.begin, s.worst));
+		if (s.end - s.worst > 1) queue.push(make_segment(s.worst, s.end));
+	}
+	knots.reserve(nknots);
+	for (size_t i = 0; i < p.size(); ++i) if (used[i]) knots.push_back(i);
+	return knots;
+}
+
+//出力画像の縦の解像度heightに対して、半ピクセル以下の誤差となるよう間引いた点をx、yに格納する。
+//節点数はwidthの数倍程度に制限される。
+inline void DecimatePoints(const SmoothPoints& p, int width, int height, std::vector<double>& x, std::vector<double>& y)
+{
+	x.clear();
+	y.clear();
+	if (p.empty()) return;
+	auto [min, max] = std::minmax_element(p.begin(), p.end(), [](const SmoothPoint& a, const SmoothPoint& b) { return a.y < b.y; });
+	double tolerance = (max->y - min->y) / std::max(height, 1) * 0.5;
+	auto knots = SelectKnots(p, tolerance, 4 * (size_t)std::max(width, 1));
+	x.reserve(knots.size());
+	y.reserve(knots.size());
+	for (auto k : knots)
+	{
+		x.push_back(p[k].x);
+		y.push_back(p[k].y);
+	}
+}
+
+//点列をそのままx、yに格納する。
+inline void CopyPoints(const SmoothPoints& p, std::vector<double>& x, std::vector<double>& y)
+{
+	x.resize(p.size());
+	y.resize(p.size());
+	for (size_t i = 0; i < p.size(); ++i) x[i] = p[i].x, y[i] = p[i].y;
+}
+
+//各節点での値gと2階微分mで与えられる3次スプラインを、[p.front().x, p.back().x]を等分するnsamples点で評価する。
+inline void EvaluateSpline(const SmoothPoints& p, const std::vector<double>& g, const std::vector<double>& m,
+						   size_t nsamples, std::vector<double>& x, std::vector<double>& y)
+{
+	size_t n = p.size();
+	nsamples = std::max<size_t>(nsamples, 2);
+	x.resize(nsamples);
+	y.resize(nsamples);
+	double xmin = p.front().x;
+	double xmax = p.back().x;
+	size_t k = 0;
+	for (size_t s = 0; s < nsamples; ++s)
+	{
+		double xs = s + 1 == nsamples ? xmax : xmin + (xmax - xmin) * (double)s / (double)(nsamples - 1);
+		while (k + 2 < n && p[k + 1].x < xs) ++k;
+		double h = p[k + 1].x - p[k].x;
+		double a = (p[k + 1].x - xs) / h;
+		double b = 1. - a;
+		x[s] = xs;
+		y[s] = a * g[k] + b * g[k + 1] + ((a * a * a - a) * m[k] + (b * b * b - b) * m[k + 1]) * h * h / 6.;
+	}
+}
+
+//x昇順で重複のない点列を通る自然3次スプライン（smooth csplines）を評価する。
+inline void CubicSplinePoints(const SmoothPoints& p, size_t nsamples, std::vector<double>& x, std::vector<double>& y)
+{
+	size_t n = p.size();
+	if (n < 3)
+	{
+		CopyPoints(p, x, y);
+		return;
+	}
+	//端点で2階微分が0となる条件の下、内部の節点の2階微分mを三重対角行列の方程式から求める。
+	std::vector<double> g(n), m(n, 0.), c(n, 0.), d(n, 0.);
+	for (size_t i = 0; i < n; ++i) g[i] = p[i].y;
+	for (size_t i = 1; i + 1 < n; ++i)
+	{
+		double h0 = p[i].x - p[i - 1].x;
+		double h1 = p[i + 1].x - p[i].x;
+		double diag = 2. * (h0 + h1) - h0 * c[i - 1];
+		c[i] = h1 / diag;
+		d[i] = (6. * ((g[i + 1] - g[i]) / h1 - (g[i] - g[i - 1]) / h0) - h0 * d[i - 1]) / diag;
+	}
+	for (size_t i = n - 2; i >= 1; --i) m[i] = d[i] - c[i] * m[i + 1];
+	EvaluateSpline(p, g, m, nsamples, x, y);
+}
+
+//重み付きの自然平滑化スプライン（smooth acsplines）を評価する。
+//sum w_i (y_i - f(x_i))^2 + int f''(x)^2 dx を最小化するfを、Reinschの方法で求める。
+inline void ApproxSplinePoints(const SmoothPoints& p, size_t nsamples, std::vector<double>& x, std::vector<double>& y)
+{
+	size_t n = p.size();
+	if (n < 3)
+	{
+		CopyPoints(p, x, y);
+		return;
+	}
+	for (const auto& q : p) if (q.w <= 0.) throw InvalidArg("weights for acsplines must be positive.");
+	std::vector<double> h(n - 1);
+	for (size_t i = 0; i + 1 < n; ++i) h[i] = p[i + 1].x - p[i].x;
+	//Q（n x (n-2)）の第j列は、行j-1, j, j+1にのみ値を持つ。
+	auto q = [&h](size_t row, size_t col) -> double
+	{
+		//colは内部節点の番号（1 ... n-2）。
+		if (row + 1 == col) return 1. / h[col - 1];
+		if (row == col) return -1. / h[col - 1] - 1. / h[col];
+		if (row == col + 1) return 1. / h[col];
+		return 0.;
+	};
+	//(R + Q^T W^-1 Q) gamma = Q^T y は対称な5重対角行列の方程式になる。LDL^T分解で解く。
+	size_t m = n - 2;
+	std::vector<double> a0(m), a1(m, 0.), a2(m, 0.), rhs(m);
+	for (size_t j = 0; j < m; ++j)
+	{
+		size_t c = j + 1;
+		a0[j] = (h[c - 1] + h[c]) / 3.;
+		for (size_t r = c - 1; r <= c + 1; ++r) a0[j] += q(r, c) * q(r, c) / p[r].w;
+		if (j + 1 < m)
+		{
+			a1[j] = h[c] / 6. + q(c, c) * q(c, c + 1) / p[c].w + q(c + 1, c) * q(c + 1, c + 1) / p[c + 1].w;
+		}
+		if (j + 2 < m) a2[j] = q(c + 1, c) * q(c + 1, c + 2) / p[c + 1].w;
+		rhs[j] = q(c - 1, c) * p[c - 1].y + q(c, c) * p[c].y + q(c + 1, c) * p[c + 1].y;
+	}
+	//LDL^T分解。l1、l2はLの下1、2段目の成分。
+	std::vector<double> dd(m), l1(m, 0.), l2(m, 0.);
+	for (size_t j = 0; j < m; ++j)
+	{
+		double v = a0[j];
+		if (j >= 1) v -= l1[j - 1] * l1[j - 1] * dd[j - 1];
+		if (j >= 2) v -= l2[j - 2] * l2[j - 2] * dd[j - 2];
+		dd[j] = v;
+		if (j + 1 < m)
+		{
+			double u = a1[j];
+			if (j >= 1) u -= l1[j - 1] * l2[j - 1] * dd[j - 1];
+			l1[j] = u / v;
+		}
+		if (j + 2 < m) l2[j] = a2[j] / v;
+	}
+	std::vector<double> gamma(m);
+	for (size_t j = 0; j < m; ++j)
+	{
+		double v = rhs[j];
+		if (j >= 1) v -= l1[j - 1] * gamma[j - 1];
+		if (j >= 2) v -= l2[j - 2] * gamma[j - 2];
+		gamma[j] = v;
+	}
+	for (size_t j = 0; j < m; ++j) gamma[j] /= dd[j];
+	for (size_t j = m; j-- > 0;)
+	{
+		if (j + 1 < m) gamma[j] -= l1[j] * gamma[j + 1];
+		if (j + 2 < m) gamma[j] -= l2[j] * gamma[j + 2];
+	}
+	//節点での値 g = y - W^-1 Q gamma。
+	std::vector<double> g(n), mm(n, 0.);
+	for (size_t i = 0; i < n; ++i)
+	{
+		double v = 0.;
+		for (size_t c = std::max<size_t>(i, 2) - 1; c <= std::min(i + 1, m); ++c) v += q(i, c) * gamma[c - 1];
+		g[i] = p[i].y - v / p[i].w;
+	}
+	for (size_t j = 0; j < m; ++j) mm[j + 1] = gamma[j];
+	EvaluateSpline(p, g, mm, nsamples, x, y);
+}
+
+//点列を制御点とするn-1次のBezier曲線（smooth bezier）を、パラメータを等分するnsamples点で評価する。
+//次数が大きい場合でも扱えるよう、Bernstein多項式の値は最頻の項から外側に向かって対数を介して計算し、
+//無視できる大きさになった時点で打ち切る。
+inline void BezierPoints(const SmoothPoints& p, size_t nsamples, std::vector<double>& x, std::vector<double>& y)
+{
+	size_t n = p.size();
+	if (n < 3)
+	{
+		CopyPoints(p, x, y);
+		return;
+	}
+	size_t deg = n - 1;
+	nsamples = std::max<size_t>(nsamples, 2);
+	x.resize(nsamples);
+	y.resize(nsamples);
+	double lgdeg = std::lgamma((double)deg + 1.);
+	ParallelFor(0, nsamples, [&](size_t b, size_t e, size_t)
+	{
+		for (size_t s = b; s < e; ++s)
+		{
+			double t = (double)s / (double)(nsamples - 1);
+			if (s == 0 || s + 1 == nsamples)
+			{
+				const auto& q = s == 0 ? p.front() : p.back();
+				x[s] = q.x, y[s] = q.y;
+				continue;
+			}
+			size_t mode = std::min(deg, (size_t)std::floor(t * (double)(deg + 1)));
+			double lw = lgdeg - std::lgamma((double)mode + 1.) - std::lgamma((double)(deg - mode) + 1.)
+				+ (double)mode * std::log(t) + (double)(deg - mode) * std::log1p(-t);
+			double w0 = std::exp(lw);
+			double ratio = t / (1. - t);
+			double sw = w0, sx = w0 * p[mode].x, sy = w0 * p[mode].y;
+			double w = w0;
+			for (size_t k = mode; k < deg; ++k)
+			{
+				w *= (double)(deg - k) / (double)(k + 1) * ratio;
+				sw += w, sx += w * p[k + 1].x, sy += w * p[k + 1].y;
+				if (w < w0 * 1e-17) break;
+			}
+			w = w0;
+			for (size_t k = mode; k > 0; --k)
+			{
+				w *= (double)k / (double)(deg - k + 1) / ratio;
+				sw += w, sx += w * p[k - 1].x, sy += w * p[k - 1].y;
+				if (w < w0 * 1e-17) break;
+			}
+			x[s] = sx / sw;
+			y[s] = sy / sw;
+		}
+	}, 64);
+}
+
+}
+
+}
+
+}
+
+#endif
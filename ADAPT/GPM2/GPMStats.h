@@ -0,0 +1,88 @@
+#ifndef GPM2_GPMSTATS_H
+#define GPM2_GPMSTATS_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+
+namespace adapt
+{
+
+namespace gpm2
+{
+
+// Cost of serializing the data of one series.
+// Times are in seconds. mIOTime is the part of mSerializeTime spent in pipe writes or temporary file I/O.
+struct GPMSeriesStats
+{
+	std::string mName;//datablock name or temporary file name
+	size_t mRows = 0;
+	size_t mBytes = 0;
+	double mSerializeTime = 0.;
+	double mIOTime = 0.;
+};
+
+// Cost of one Flush(), i.e. one plot/splot command and the series serialized for it.
+struct GPMFlushStats
+{
+	std::vector<GPMSeriesStats> mSeries;
+	size_t mCommandBytes = 0;//bytes of the plot command and the following reset commands
+	double mFlushTime = 0.;//time to assemble and send the plot command
+
+	size_t GetRows() const { size_t n = 0; for (auto& s : mSeries) n += s.mRows; return n; }
+	size_t GetBytes() const { size_t n = mCommandBytes; for (auto& s : mSeries) n += s.mBytes; return n; }
+	double GetSerializeTime() const { double t = 0.; for (auto& s : mSeries) t += s.mSerializeTime; return t; }
+	double GetIOTime() const { double t = 0.; for (auto& s : mSeries) t += s.mIOTime; return t; }
+};
+
+// Running totals over all flushes of a canvas.
+struct GPMFlushTotals
+{
+	size_t mFlushes = 0;
+	size_t mSeries = 0;
+	size_t mRows = 0;
+	size_t mBytes = 0;//including the plot commands
+	double mSerializeTime = 0.;
+	double mIOTime = 0.;
+	double mFlushTime = 0.;
+
+	void Add(const GPMFlushStats& f)
+	{
+		++mFlushes;
+		mSeries += f.mSeries.size();
+		mRows += f.GetRows();
+		mBytes += f.GetBytes();
+		mSerializeTime += f.GetSerializeTime();
+		mIOTime += f.GetIOTime();
+		mFlushTime += f.mFlushTime;
+	}
+};
+
+struct GPMCanvasStats
+{
+	// At most this many recent flushes are kept in mFlushes, so that a long-lived canvas (e.g. GPMAnimation) does not grow without limit.
+	static constexpr size_t msMaxRecentFlushes = 64;
+
+	double mSpawnTime = 0.;//time to start gnuplot (or open the sink)
+	double mWaitTime = 0.;//time waiting for gnuplot to finish. Known only when the canvas is destroyed.
+	size_t mBytes = 0;//bytes written to the sink, excluding temporary files
+	std::vector<GPMFlushStats> mFlushes;//the most recent flushes, oldest first
+	GPMFlushTotals mTotal;//all flushes, including those dropped from mFlushes
+	GPMFlushStats mPending;//series serialized by Plot() but not flushed yet
+};
+
+namespace detail
+{
+
+inline double GetElapsedTime(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+}
+
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef GPM2_GPMTRACE_H
+#define GPM2_GPMTRACE_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <ADAPT/CUF/Exception.h>
+
+namespace adapt
+{
+
+namespace gpm2
+{
+
+// Records spans of the plotting pipeline (sink opening, serialization of each series, Flush, pipe writes, waiting for gnuplot)
+// and saves them in the Chrome trace event format, which chrome://tracing and ui.perfetto.dev can open.
+// Tracing is off by default. While it is off, each hook costs one relaxed atomic load.
+// Defining GPM2_DISABLE_TRACE removes the hooks entirely.
+class GPMTrace
+{
+public:
+
+	static void Start();
+	static void Stop();
+	static bool IsEnabled();
+	// Write the recorded events to path as JSON. The events are kept, so Save can be called repeatedly.
+	static void Save(const std::string& path);
+	static void Clear();
+
+	//以下はGPM2内部のフックが用いる。
+	static void AddEvent(const char* name, const std::string& arg,
+						 std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+private:
+
+	struct Event
+	{
+		const char* mName;
+		std::string mArg;
+		double mBegin;//開始時刻（マイクロ秒）
+		double mDuration;
+		size_t mThread;
+	};
+	static size_t GetThreadIndex();
+
+	template <class = void>
+	struct State
+	{
+		static std::atomic<bool> msEnabled;
+		static std::mutex msMutex;
+		static std::vector<Event> msEvents;
+		static std::atomic<size_t> msNumThreads;
+		static const std::chrono::steady_clock::time_point msOrigin;
+	};
+};
+
+template <class T>
+std::atomic<bool> GPMTrace::State<T>::msEnabled{ false };
+template <class T>
+std::mutex GPMTrace::State<T>::msMutex;
+template <class T>
+std::vector<GPMTrace::Event> GPMTrace::State<T>::msEvents;
+template <class T>
+std::atomic<size_t> GPMTrace::State<T>::msNumThreads{ 0 };
+template <class T>
+const std::chrono::steady_clock::time_point GPMTrace::State<T>::msOrigin = std::chrono::steady_clock::now();
+
+inline void GPMTrace::Start()
+{
+	State<>::msEnabled.store(true, std::memory_order_relaxed);
+}
+inline void GPMTrace::Stop()
+{
+	State<>::msEnabled.store(false, std::memory_order_relaxed);
+}
+inline bool GPMTrace::IsEnabled()
+{
+#ifdef GPM2_DISABLE_TRACE
+	return false;
+#else
+	return State<>::msEnabled.load(std::memory_order_relaxed);
+#endif
+}
+inline void GPMTrace::Clear()
+{
+	std::lock_guard<std::mutex> lock(State<>::msMutex);
+	State<>::msEvents.clear();
+}
+inline size_t GPMTrace::GetThreadIndex()
+{
+	//Chrome traceのtidには小さい整数が見やすいので、スレッドごとに通し番号を振る。
+	thread_local size_t index = State<>::msNumThreads.fetch_add(1) + 1;
+	return index;
+}
+inline void GPMTrace::AddEvent(const char* name, const std::string& arg,
+							   std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+{
+	Event e{ name, arg,
+		std::chrono::duration<double, std::micro>(begin - State<>::msOrigin).count(),
+		std::chrono::duration<double, std::micro>(end - begin).count(),
+		GetThreadIndex() };
+	std::lock_guard<std::mutex> lock(State<>::msMutex);
+	State<>::msEvents.push_back(std::move(e));
+}
+inline void GPMTrace::Save(const std::string& path)
+{
+	auto escape = [](const std::string& str)
+	{
+		std::string res;
+		for (char c : str)
+		{
+			if (c == '"' || c == '\\') res += '\\', res += c;
+			else if ((unsigned char)c < 0x20) res += ' ';
+			else res += c;
+		}
+		return res;
+	};
+	std::ofstream ofs(path);
+	if (!ofs) throw InvalidArg("file \"" + path + "\" cannot open.");
+	std::lock_guard<std::mutex> lock(State<>::msMutex);
+	ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	char buf[128];
+	bool first = true;
+	for (auto& e : State<>::msEvents)
+	{
+		snprintf(buf, sizeof(buf), "\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f", e.mThread, e.mBegin, e.mDuration);
+		ofs << (first ? "\n" : ",\n") << "{\"name\":\"" << e.mName << "\",\"cat\":\"gpm2\"," << buf;
+		if (!e.mArg.empty()) ofs << ",\"args\":{\"name\":\"" << escape(e.mArg) << "\"}";
+		ofs << "}";
+		first = false;
+	}
+	ofs << "\n]}\n";
+}
+
+namespace detail
+{
+
+//生存期間をひとつのspanとして記録する。トレースが無効なら何もしない。
+class TraceScope
+{
+public:
+
+	explicit TraceScope(const char* name)
+		: mName(name), mArg(nullptr), mEnabled(GPMTrace::IsEnabled())
+	{
+		if (mEnabled) mBegin = std::chrono::steady_clock::now();
+	}
+	TraceScope(const char* name, const std::string& arg)
+		: mName(name), mArg(&arg), mEnabled(GPMTrace::IsEnabled())
+	{
+		if (mEnabled) mBegin = std::chrono::steady_clock::now();
+	}
+	TraceScope(const char* name, std::string&& arg) = delete;//argは参照で保持するので一時オブジェクトは渡せない。
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+	~TraceScope()
+	{
+		if (mEnabled) GPMTrace::AddEvent(mName, mArg ? *mArg : std::string(), mBegin, std::chrono::steady_clock::now());
+	}
+
+private:
+
+	const char* mName;
+	const std::string* mArg;
+	bool mEnabled;
+	std::chrono::steady_clock::time_point mBegin;
+};
+
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,162 @@
+#include <ADAPT/CUF/Matrix.h>
+#include <chrono>
+#include <limits>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+//Matrixのコピー、代入、初期化の性能を測る。
+//
+//usage: cuf_matrix_bench [--min-size N] [--max-size N] [--format csv|json] [--min-time SEC]
+//
+//sizeは正方行列の一辺の長さで、min-sizeから4倍ずつmax-sizeまで測る。
+//copy      : コピーコンストラクタ。
+//assign    : 同じ大きさの行列へのコピー代入。
+//construct : 大きさと初期値を与えたコンストラクタ（初期値0と1）。
+//fill      : Fill。
+//end       : end()の呼び出し（要素数の取得）のみ。
+//baseline  : 要素ごとのplacement newによるコピー。memcpyを用いない場合の参考値。
+//
+//各測定はmin-time秒以上になるまで繰り返し、最も速かった回を報告する。
+
+namespace
+{
+
+struct Options
+{
+	size_t mMinSize = 256;
+	size_t mMaxSize = 4096;
+	double mMinTime = 0.2;
+	bool mJson = false;
+};
+
+struct Result
+{
+	std::string mBenchmark;
+	std::string mType;
+	size_t mSize;
+	size_t mBytes;
+	size_t mRuns;
+	double mSeconds;//1回あたりの最短時間。
+};
+
+void PrintHeader(const Options& o)
+{
+	if (!o.mJson) std::printf("benchmark,type,size,bytes,runs,seconds,bytes_per_sec\n");
+}
+void PrintResult(const Options& o, const Result& r)
+{
+	double bps = r.mBytes / r.mSeconds;
+	if (o.mJson)
+	{
+		std::printf("{\"benchmark\":\"%s\",\"type\":\"%s\",\"size\":%zu,\"bytes\":%zu,\"runs\":%zu,\"seconds\":%.9g,\"bytes_per_sec\":%.6g}\n",
+					r.mBenchmark.c_str(), r.mType.c_str(), r.mSize, r.mBytes, r.mRuns, r.mSeconds, bps);
+	}
+	else
+	{
+		std::printf("%s,%s,%zu,%zu,%zu,%.9g,%.6g\n",
+					r.mBenchmark.c_str(), r.mType.c_str(), r.mSize, r.mBytes, r.mRuns, r.mSeconds, bps);
+	}
+	std::fflush(stdout);
+}
+
+//fをmin-time秒以上になるまで繰り返し、最短の時間を返す。
+template <class Func>
+double Measure(const Options& o, Func f, size_t& runs)
+{
+	double best = std::numeric_limits<double>::infinity();
+	double total = 0.;
+	runs = 0;
+	do
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		f();
+		auto t1 = std::chrono::steady_clock::now();
+		double t = std::chrono::duration<double>(t1 - t0).count();
+		best = std::min(best, t);
+		total += t;
+		++runs;
+	} while (total < o.mMinTime);
+	return best;
+}
+
+//最適化で計算が消されないように結果を参照する。
+volatile double gSink = 0.;
+template <class T>
+void Consume(const adapt::Matrix<T>& m)
+{
+	gSink = gSink + (double)*m.begin() + (double)*(m.end() - 1);
+}
+
+template <class T>
+void BenchType(const Options& o, const char* type)
+{
+	for (size_t size = o.mMinSize; size <= o.mMaxSize; size *= 4)
+	{
+		uint32_t n = (uint32_t)size;
+		size_t bytes = size * size * sizeof(T);
+		adapt::Matrix<T> src(n, n);
+		src.Generate([](uint32_t i, uint32_t j) { return (T)(i * 3 + j); });
+		adapt::Matrix<T> dst(n, n);
+		auto run = [&](const char* name, auto f)
+		{
+			size_t runs = 0;
+			double t = Measure(o, f, runs);
+			PrintResult(o, Result{ name, type, size, bytes, runs, t });
+		};
+
+		run("copy", [&]() { adapt::Matrix<T> m(src); Consume(m); });
+		run("assign", [&]() { dst = src; Consume(dst); });
+		run("construct0", [&]() { adapt::Matrix<T> m(n, n); Consume(m); });
+		run("construct1", [&]() { adapt::Matrix<T> m(n, n, (T)1); Consume(m); });
+		run("fill", [&]() { dst.Fill((T)2); Consume(dst); });
+		run("end", [&]()
+		{
+			const T* e = nullptr;
+			for (int i = 0; i < 1000; ++i) e = src.end() - (i & 1);
+			gSink = gSink + (double)*e;
+		});
+		run("baseline", [&]()
+		{
+			T* p = dst.begin();
+			const T* q = src.begin();
+			for (size_t i = 0, cap = src.GetCapacity(); i < cap; ++i) new (p + i) T(q[i]);
+			Consume(dst);
+		});
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options o;
+	for (int i = 1; i < argc; ++i)
+	{
+		auto next = [&]() -> const char*
+		{
+			if (i + 1 >= argc)
+			{
+				std::fprintf(stderr, "missing value for %s\n", argv[i]);
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+		if (!std::strcmp(argv[i], "--min-size")) o.mMinSize = (size_t)std::atof(next());
+		else if (!std::strcmp(argv[i], "--max-size")) o.mMaxSize = (size_t)std::atof(next());
+		else if (!std::strcmp(argv[i], "--min-time")) o.mMinTime = std::atof(next());
+		else if (!std::strcmp(argv[i], "--format")) o.mJson = !std::strcmp(next(), "json");
+		else
+		{
+			std::fprintf(stderr, "usage: %s [--min-size N] [--max-size N] [--format csv|json] [--min-time SEC]\n", argv[0]);
+			return 1;
+		}
+	}
+	o.mMinSize = std::max<size_t>(o.mMinSize, 1);
+
+	PrintHeader(o);
+	BenchType<double>(o, "double");
+	BenchType<float>(o, "float");
+	BenchType<uint32_t>(o, "uint32");
+}
@@ -0,0 +1,212 @@
+#include <ADAPT/GPM2/GPMCanvas.h>
+#include <chrono>
+#include <random>
+#include <cstring>
+
+//GPM2のデータ転送と描画の性能を測る。
+//
+//usage: gpm2_bench [--min-size N] [--max-size N] [--format csv|json] [--min-time SEC] [--gnuplot PATH]
+//
+//点数はmin-size（既定1e3）からmax-size（既定1e8）まで10倍ずつ変える。
+//1e8点では数GBのメモリと一時ファイルを使うので、手元で軽く測る場合は--max-size 1e6などで上限を下げる。
+//
+//serialize : MakeDataObjectCommonによる書き出しの行/s、バイト/s。
+//            datablockモードはGPMNullSinkに、fileモードは一時ディレクトリのファイルに書き出す。
+//flush     : キャンバスの作成からPlotPoints、gnuplotの終了までの時間。
+//            gnuplotは--gnuplot、GNUPLOT_PATH、gpm2_fake_gnuplotの順に選ばれる。
+//
+//各測定はmin-time秒以上になるまで繰り返し、最も速かった回を報告する。
+
+using namespace adapt::gpm2;
+
+namespace
+{
+
+struct Options
+{
+	size_t mMinSize = 1000;
+	size_t mMaxSize = 100000000;
+	double mMinTime = 0.2;
+	bool mJson = false;
+	std::string mGnuplot;
+};
+
+struct Result
+{
+	std::string mBenchmark;
+	std::string mMode;
+	std::string mKind;
+	size_t mSize;
+	size_t mRows;
+	size_t mBytes;
+	size_t mRuns;
+	double mSeconds;//1回あたりの最短時間。
+};
+
+void PrintHeader(const Options& o)
+{
+	if (!o.mJson) std::printf("benchmark,mode,kind,size,rows,bytes,runs,seconds,rows_per_sec,bytes_per_sec\n");
+}
+void PrintResult(const Options& o, const Result& r)
+{
+	double rps = r.mRows / r.mSeconds;
+	double bps = r.mBytes / r.mSeconds;
+	if (o.mJson)
+	{
+		std::printf("{\"benchmark\":\"%s\",\"mode\":\"%s\",\"kind\":\"%s\",\"size\":%zu,\"rows\":%zu,\"bytes\":%zu,"
+					"\"runs\":%zu,\"seconds\":%.9g,\"rows_per_sec\":%.6g,\"bytes_per_sec\":%.6g}\n",
+					r.mBenchmark.c_str(), r.mMode.c_str(), r.mKind.c_str(), r.mSize, r.mRows, r.mBytes, r.mRuns, r.mSeconds, rps, bps);
+	}
+	else
+	{
+		std::printf("%s,%s,%s,%zu,%zu,%zu,%zu,%.9g,%.6g,%.6g\n",
+					r.mBenchmark.c_str(), r.mMode.c_str(), r.mKind.c_str(), r.mSize, r.mRows, r.mBytes, r.mRuns, r.mSeconds, rps, bps);
+	}
+	std::fflush(stdout);
+}
+
+//fをmin-time秒以上になるまで繰り返し、最短の時間を返す。
+template <class Func>
+double Measure(const Options& o, Func f, size_t& runs)
+{
+	double best = std::numeric_limits<double>::infinity();
+	double total = 0.;
+	runs = 0;
+	do
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		f();
+		auto t1 = std::chrono::steady_clock::now();
+		double t = std::chrono::duration<double>(t1 - t0).count();
+		best = std::min(best, t);
+		total += t;
+		++runs;
+	} while (total < o.mMinTime);
+	return best;
+}
+
+//シリアライズのみを測るため、コマンドはGPMNullSinkに捨てる。
+void BenchSerialize(const Options& o, const std::filesystem::path& tmpdir)
+{
+	GPMCanvas::SetSinkFactory([](const std::string&) { return std::make_shared<GPMNullSink>(); });
+	std::mt19937_64 mt(0);
+	std::uniform_real_distribution<> ud(-1000., 1000.);
+	for (size_t size = o.mMinSize; size <= o.mMaxSize; size *= 10)
+	{
+		std::vector<double> x(size), y(size);
+		for (auto& v : x) v = ud(mt);
+		for (auto& v : y) v = ud(mt);
+		std::vector<std::string> labels(size);
+		for (size_t i = 0; i < size; ++i) labels[i] = "label" + std::to_string(i % 1000);
+		//行数がおよそsizeになる正方行列。
+		uint32_t side = (uint32_t)std::max(2., std::floor(std::sqrt((double)size)));
+		adapt::Matrix<double> map(side, side);
+		for (uint32_t ix = 0; ix < side; ++ix)
+			for (uint32_t iy = 0; iy < side; ++iy) map[ix][iy] = ud(mt);
+
+		for (int datablock = 0; datablock < 2; ++datablock)
+		{
+			GPMCanvas g;
+			g.EnableInMemoryDataTransfer(datablock == 1);
+			std::string name = datablock ? "$bench" : (tmpdir / "bench.txt").string();
+			auto run = [&](const std::string& kind, size_t rows, auto make)
+			{
+				size_t before = g.GetSink()->GetBytes();
+				size_t runs = 0;
+				double t = Measure(o, make, runs);
+				size_t bytes = datablock ? (g.GetSink()->GetBytes() - before) / runs : (size_t)std::filesystem::file_size(name);
+				PrintResult(o, Result{ "serialize", datablock ? "datablock" : "file", kind, size, rows, bytes, runs, t });
+			};
+			run("vector", size, [&]()
+			{
+				std::vector<detail::DataIterator> its = { x.cbegin(), y.cbegin() };
+				detail::MakeDataObject(&g, name, its, size);
+			});
+			run("string", size, [&]()
+			{
+				std::vector<detail::DataIterator> its = { labels.cbegin(), y.cbegin() };
+				detail::MakeDataObject(&g, name, its, size);
+			});
+			run("matrix", (size_t)(side + 1) * (side + 1), [&]()
+			{
+				detail::MakeDataObject(&g, name, MakeView(map), detail::GetCoordFromRange({ 0., 1. }, side), detail::GetCoordFromRange({ 0., 1. }, side));
+			});
+		}
+	}
+	GPMCanvas::SetSinkFactory(nullptr);
+}
+
+void BenchFlush(const Options& o, const std::filesystem::path& tmpdir)
+{
+	GPMCanvas::SetGnuplotPath(o.mGnuplot);
+	std::mt19937_64 mt(1);
+	std::uniform_real_distribution<> ud(-1000., 1000.);
+	std::string output = (tmpdir / "bench.png").string();
+	for (size_t size = o.mMinSize; size <= o.mMaxSize; size *= 10)
+	{
+		std::vector<double> x(size), y(size);
+		for (auto& v : x) v = ud(mt);
+		for (auto& v : y) v = ud(mt);
+		for (int datablock = 0; datablock < 2; ++datablock)
+		{
+			size_t bytes = 0;
+			size_t runs = 0;
+			//キャンバスの破棄でgnuplotが終了するまで待つので、描画の完了までを含む。
+			double t = Measure(o, [&]()
+			{
+				GPMCanvas2D g(output);
+				g.EnableInMemoryDataTransfer(datablock == 1);
+				g.PlotPoints(x, y);
+				bytes = g.GetSink() ? g.GetSink()->GetBytes() : 0;
+			}, runs);
+			if (!datablock) bytes += (size_t)std::filesystem::file_size(output + ".tmp0.txt");
+			PrintResult(o, Result{ "flush", datablock ? "datablock" : "file", "vector", size, size, bytes, runs, t });
+		}
+	}
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	Options o;
+	for (int i = 1; i < argc; ++i)
+	{
+		auto next = [&]() -> const char*
+		{
+			if (i + 1 >= argc)
+			{
+				std::fprintf(stderr, "missing value for %s\n", argv[i]);
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+		if (!std::strcmp(argv[i], "--min-size")) o.mMinSize = (size_t)std::atof(next());
+		else if (!std::strcmp(argv[i], "--max-size")) o.mMaxSize = (size_t)std::atof(next());
+		else if (!std::strcmp(argv[i], "--min-time")) o.mMinTime = std::atof(next());
+		else if (!std::strcmp(argv[i], "--format")) o.mJson = !std::strcmp(next(), "json");
+		else if (!std::strcmp(argv[i], "--gnuplot")) o.mGnuplot = next();
+		else
+		{
+			std::fprintf(stderr, "usage: %s [--min-size N] [--max-size N] [--format csv|json] [--min-time SEC] [--gnuplot PATH]\n"
+						 "  sizes go from --min-size (default 1e3) to --max-size (default 1e8) in steps of 10x.\n"
+						 "  1e8 needs several GB of memory and temporary files; pass e.g. --max-size 1e6 for a quick run.\n", argv[0]);
+			return 1;
+		}
+	}
+	if (o.mGnuplot.empty()) o.mGnuplot = adapt::GetEnv("GNUPLOT_PATH");
+	o.mMinSize = std::max<size_t>(o.mMinSize, 10);
+
+	std::filesystem::path tmpdir = std::filesystem::temp_directory_path() / "gpm2_bench";
+	std::filesystem::create_directories(tmpdir);
+#ifdef GPM2_FAKE_GNUPLOT
+	//gnuplotが指定されていなければ、一緒にビルドされた代替プログラムで転送のみを測る。
+	if (o.mGnuplot.empty())
+		o.mGnuplot = std::string("\"") + GPM2_FAKE_GNUPLOT + "\" --report \"" + (tmpdir / "fake_gnuplot.txt").string() + "\"";
+#endif
+	PrintHeader(o);
+	BenchSerialize(o, tmpdir);
+	if (!o.mGnuplot.empty()) BenchFlush(o, tmpdir);
+	std::error_code ec;
+	std::filesystem::remove_all(tmpdir, ec);
+}
@@ -0,0 +1,324 @@
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+
+//gnuplotの代わりにGPMCanvasから起動し、受け取ったコマンドとデータの量を数えるだけのプログラム。
+//gnuplotのない環境でのベンチマークやCIで、GPMCanvas::SetGnuplotPathかGNUPLOT_PATHに指定して使う。
+//
+//usage: gpm2_fake_gnuplot [--report FILE] [SCRIPT...]
+//
+//・"$name << EOD"から"EOD"までのdatablockの行数とバイト数を数える。
+//・plot/splotで"'file' using"の形で参照されたファイルを読み、行数とバイト数を数える。
+//・"set print"/"unset print"/"print"をgnuplotと同様に扱う。printの出力先の既定値はstderr。
+//  ただし引数は文字列リテラルのみに対応し、式は評価せずそのまま出力する。
+//・"cd"と"load"に対応する。引数で与えられたスクリプトは、標準入力より先に順に読まれる。
+//・終了時（exit、quitまたは入力の終わり）に集計結果をJSONの1行として--reportのファイルに追記する。
+//  --reportがなければstderrに出力する。
+
+namespace
+{
+
+struct Counter
+{
+	size_t mCommands = 0;
+	size_t mBytes = 0;//受け取ったコマンドストリームの総バイト数。
+	size_t mPlots = 0;
+	size_t mDataBlocks = 0;
+	size_t mDataBlockRows = 0;
+	size_t mDataBlockBytes = 0;
+	size_t mFiles = 0;
+	size_t mFileRows = 0;
+	size_t mFileBytes = 0;
+	size_t mMissingFiles = 0;
+	size_t mPrints = 0;
+};
+
+class FakeGnuplot
+{
+public:
+
+	FakeGnuplot() : mPrint(stderr), mExit(false) {}
+	~FakeGnuplot()
+	{
+		if (mPrint != stderr && mPrint != stdout) std::fclose(mPrint);
+	}
+
+	//inから読めなくなるか、exitを受け取るまで処理する。
+	void Run(std::FILE* in)
+	{
+		std::string line;
+		while (!mExit && ReadLine(in, line))
+		{
+			//行末の\で次の行に続く。
+			while (!line.empty() && line.back() == '\\')
+			{
+				line.pop_back();
+				std::string next;
+				if (!ReadLine(in, next)) break;
+				line += next;
+			}
+			Execute(line, in);
+		}
+	}
+
+	void Report(const std::string& path) const
+	{
+		std::FILE* fp = path.empty() ? stderr : std::fopen(path.c_str(), "a");
+		if (fp == nullptr)
+		{
+			std::fprintf(stderr, "gpm2_fake_gnuplot: cannot open %s\n", path.c_str());
+			return;
+		}
+		const Counter& c = mCounter;
+		std::fprintf(fp, "{\"commands\":%zu,\"bytes\":%zu,\"plots\":%zu,\"datablocks\":%zu,\"datablock_rows\":%zu,\"datablock_bytes\":%zu,"
+					 "\"files\":%zu,\"file_rows\":%zu,\"file_bytes\":%zu,\"missing_files\":%zu,\"prints\":%zu}\n",
+					 c.mCommands, c.mBytes, c.mPlots, c.mDataBlocks, c.mDataBlockRows, c.mDataBlockBytes,
+					 c.mFiles, c.mFileRows, c.mFileBytes, c.mMissingFiles, c.mPrints);
+		if (fp != stderr) std::fclose(fp);
+	}
+
+private:
+
+	bool ReadLine(std::FILE* in, std::string& line)
+	{
+		line.clear();
+		char buf[4096];
+		while (std::fgets(buf, sizeof(buf), in) != nullptr)
+		{
+			size_t len = std::strlen(buf);
+			mCounter.mBytes += len;
+			line.append(buf, len);
+			if (line.back() == '\n')
+			{
+				line.pop_back();
+				if (!line.empty() && line.back() == '\r') line.pop_back();
+				return true;
+			}
+		}
+		return !line.empty();
+	}
+
+	static size_t SkipSpace(const std::string& s, size_t pos)
+	{
+		while (pos < s.size() && std::isspace((unsigned char)s[pos])) ++pos;
+		return pos;
+	}
+	static std::string Word(const std::string& s, size_t& pos)
+	{
+		pos = SkipSpace(s, pos);
+		size_t begin = pos;
+		while (pos < s.size() && (std::isalnum((unsigned char)s[pos]) || s[pos] == '_' || s[pos] == '$')) ++pos;
+		return s.substr(begin, pos - begin);
+	}
+	//posが引用符を指していれば、文字列リテラルを読んでtrueを返す。gnuplotと同様に''は'を表す。
+	static bool Quoted(const std::string& s, size_t& pos, std::string& res)
+	{
+		pos = SkipSpace(s, pos);
+		if (pos >= s.size() || (s[pos] != '\'' && s[pos] != '"')) return false;
+		char q = s[pos++];
+		res.clear();
+		while (pos < s.size())
+		{
+			char c = s[pos++];
+			if (c == q)
+			{
+				if (q == '\'' && pos < s.size() && s[pos] == '\'') { res += '\''; ++pos; continue; }
+				return true;
+			}
+			if (q == '"' && c == '\\' && pos < s.size())
+			{
+				char e = s[pos++];
+				res += e == 'n' ? '\n' : e == 't' ? '\t' : e;
+				continue;
+			}
+			res += c;
+		}
+		return true;
+	}
+
+	void Execute(const std::string& line, std::FILE* in)
+	{
+		size_t pos = SkipSpace(line, 0);
+		if (pos >= line.size() || line[pos] == '#') return;
+		++mCounter.mCommands;
+
+		size_t p = pos;
+		std::string head = Word(line, p);
+		if (!head.empty() && head[0] == '$')
+		{
+			//$name << EOD
+			p = SkipSpace(line, p);
+			if (line.compare(p, 2, "<<") == 0)
+			{
+				p += 2;
+				std::string terminator = Word(line, p);
+				ReadDataBlock(in, terminator);
+			}
+			return;
+		}
+		if (head == "exit" || head == "quit" || head == "q")
+		{
+			mExit = true;
+		}
+		else if (head == "plot" || head == "p" || head == "splot" || head == "sp" || head == "replot")
+		{
+			++mCounter.mPlots;
+			ScanPlot(line, p);
+		}
+		else if (head == "print" || head == "pr")
+		{
+			++mCounter.mPrints;
+			std::string str;
+			std::string out;
+			//print 'a', "b"のように、カンマ区切りの文字列を空白で連結して出力する。
+			while (true)
+			{
+				if (Quoted(line, p, str)) out += str;
+				else
+				{
+					size_t b = SkipSpace(line, p);
+					p = std::min(line.find(',', b), line.size());
+					out += line.substr(b, p - b);
+				}
+				p = SkipSpace(line, p);
+				if (p < line.size() && line[p] == ',') { ++p; out += ' '; }
+				else break;
+			}
+			std::fprintf(mPrint, "%s\n", out.c_str());
+			std::fflush(mPrint);
+		}
+		else if (head == "set" || head == "unset")
+		{
+			size_t q = p;
+			std::string what = Word(line, q);
+			if (what != "print") return;
+			if (mPrint != stderr && mPrint != stdout) std::fclose(mPrint);
+			mPrint = stderr;
+			std::string path;
+			if (head == "set" && Quoted(line, q, path))
+			{
+				if (path == "-") mPrint = stdout;
+				else
+				{
+					bool append = Word(line, q) == "append";
+					std::FILE* fp = std::fopen(path.c_str(), append ? "a" : "w");
+					if (fp != nullptr) mPrint = fp;
+				}
+			}
+		}
+		else if (head == "cd")
+		{
+			std::string dir;
+			if (Quoted(line, p, dir))
+			{
+				std::error_code ec;
+				std::filesystem::current_path(dir, ec);
+				if (ec) std::fprintf(stderr, "gpm2_fake_gnuplot: cannot cd to %s\n", dir.c_str());
+			}
+		}
+		else if (head == "load" || head == "l")
+		{
+			std::string path;
+			if (Quoted(line, p, path)) Load(path);
+		}
+	}
+
+	void ReadDataBlock(std::FILE* in, const std::string& terminator)
+	{
+		++mCounter.mDataBlocks;
+		std::string line;
+		while (ReadLine(in, line))
+		{
+			if (line == terminator) return;
+			++mCounter.mDataBlockRows;
+			mCounter.mDataBlockBytes += line.size() + 1;
+		}
+	}
+
+	//"'file' using"の形のファイル参照を探す。
+	void ScanPlot(const std::string& line, size_t p)
+	{
+		std::string name;
+		while (p < line.size())
+		{
+			size_t q = p;
+			if (Quoted(line, q, name))
+			{
+				size_t r = q;
+				std::string next = Word(line, r);
+				if (next == "using" || next == "u") CountFile(name);
+				p = q;
+			}
+			else ++p;
+		}
+	}
+
+	void CountFile(const std::string& name)
+	{
+		std::ifstream ifs(name, std::ios::binary);
+		if (!ifs)
+		{
+			++mCounter.mMissingFiles;
+			return;
+		}
+		++mCounter.mFiles;
+		std::string line;
+		while (std::getline(ifs, line))
+		{
+			mCounter.mFileBytes += line.size() + 1;
+			size_t pos = SkipSpace(line, 0);
+			if (pos < line.size() && line[pos] != '#') ++mCounter.mFileRows;
+		}
+	}
+
+	void Load(const std::string& path)
+	{
+		std::FILE* fp = std::fopen(path.c_str(), "r");
+		if (fp == nullptr)
+		{
+			std::fprintf(stderr, "gpm2_fake_gnuplot: cannot open %s\n", path.c_str());
+			return;
+		}
+		//loadしたスクリプト中のexitは、gnuplotと同様にプログラム全体を終了させる。
+		Run(fp);
+		std::fclose(fp);
+	}
+
+	Counter mCounter;
+	std::FILE* mPrint;
+	bool mExit;
+};
+
+}
+
+int main(int argc, char** argv)
+{
+	std::string report;
+	std::vector<std::string> scripts;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!std::strcmp(argv[i], "--report") && i + 1 < argc) report = argv[++i];
+		else if (!std::strcmp(argv[i], "--persist") || !std::strcmp(argv[i], "-p")) continue;
+		else scripts.push_back(argv[i]);
+	}
+	FakeGnuplot g;
+	for (auto& s : scripts)
+	{
+		std::FILE* fp = std::fopen(s.c_str(), "r");
+		if (fp == nullptr)
+		{
+			std::fprintf(stderr, "gpm2_fake_gnuplot: cannot open %s\n", s.c_str());
+			continue;
+		}
+		g.Run(fp);
+		std::fclose(fp);
+	}
+	g.Run(stdin);
+	g.Report(report);
+}
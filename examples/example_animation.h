@@ -0,0 +1,51 @@
+#ifndef EXAMPLE_ANIMATION_H
+#define EXAMPLE_ANIMATION_H
+
+#include <ADAPT/GPM2/GPMCanvas.h>
+#include <cmath>
+
+using namespace adapt::gpm2;
+
+int example_animation(const std::string output_filename = "example_animation.gif")
+{
+	/*
+	GPMAnimation2D / GPMAnimationCM(const std::string& output, double sizex = 0., double sizey = 0., int delay = 10)
+	keep one gnuplot session for all frames.
+	If output is a gif file, each plot becomes a frame of an animated gif (delay is in 1/100 seconds).
+	If output contains an integer conversion like "frame%04d.png", each frame is written to its own file.
+	Call NextFrame() before plotting each frame.
+	*/
+
+	GPMAnimationCM g(output_filename, 400, 400, 5);
+	adapt::Matrix<double> m(60, 60);
+	std::pair<double, double> xrange = { -5., 5. };
+	std::pair<double, double> yrange = { -5., 5. };
+	std::vector<double> cx(1), cy(1);
+	for (int frame = 0; frame < 30; ++frame)
+	{
+		double t = frame * 2 * 3.14159265358979 / 30;
+		cx[0] = 2 * std::cos(t);
+		cy[0] = 2 * std::sin(t);
+		for (uint32_t ix = 0; ix < 60; ++ix)
+		{
+			double x = -5. + ix / 6.;
+			for (uint32_t iy = 0; iy < 60; ++iy)
+			{
+				double y = -5. + iy / 6.;
+				m[ix][iy] = std::exp(-((x - cx[0]) * (x - cx[0]) + (y - cy[0]) * (y - cy[0])));
+			}
+		}
+
+		g.NextFrame();
+		//Settings repeated every frame are sent to gnuplot only once.
+		g.SetTitle("example\\_animation");
+		g.SetXRange(-5, 5);
+		g.SetYRange(-5, 5);
+		g.SetCBRange(0, 1);
+		g.PlotColormap(m, xrange, yrange, plot::title = "notitle").
+			PlotPoints(cx, cy, plot::title = "notitle", plot::color = "white");
+	}
+	return 0;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef EXAMPLE_BOXPLOT_H
+#define EXAMPLE_BOXPLOT_H
+
+#include <ADAPT/GPM2/GPMCanvas.h>
+#include <random>
+
+using namespace adapt::gpm2;
+
+int example_boxplot(const std::string output_filename = "example_boxplot.png", const bool enable_in_memory_data_transfer = false)
+{
+	std::mt19937_64 mt(0);
+	std::vector<std::string> labels = { "normal", "exponential", "lognormal", "cauchy" };
+	std::vector<std::vector<double>> groups(4, std::vector<double>(100000));
+	std::normal_distribution<> n(1., 1.);
+	std::exponential_distribution<> e(1.);
+	std::lognormal_distribution<> l(0., 0.5);
+	std::cauchy_distribution<> c(1., 0.3);
+	for (auto& v : groups[0]) v = n(mt);
+	for (auto& v : groups[1]) v = e(mt);
+	for (auto& v : groups[2]) v = l(mt);
+	for (auto& v : groups[3]) v = c(mt);
+
+	/*
+	1. PlotBoxes(const std::vector<double>& x, const std::vector<double>& y, Options ...options)
+	2. PlotBoxes(std::vector<std::vector<double>> groups, Options ...options)
+	quartiles, whiskers and outliers of each group are computed in C++ (1. groups y by the value of x),
+	and only the summaries are sent to gnuplot.
+	3. PlotCandlesticks(x, box_min, whisker_min, whisker_max, box_max, Options ...options)
+	draws candlesticks from the given columns.
+	 * options for Boxes and Candlesticks
+	title          ... title.
+	x              ... positions or labels of the groups for PlotBoxes 2. (0, 1, 2, ... by default)
+	linetype, linewidth, color ... style of the borders and whiskers.
+	fillpattern, fillsolid, filltransparent, fillcolor, bordercolor, bordertype ... style of the boxes.
+	boxwidth       ... width of the boxes in the unit of x axis.
+	whiskerbars    ... length of the bars at the end of the whiskers relative to the box width.
+	whiskerrange   ... whiskers extend to the most extreme data within this multiple of the IQR. (1.5 by default)
+	without_outliers ... outliers are not drawn.
+	*/
+
+	GPMCanvas2D g(output_filename);
+	g.ShowCommands(true);
+	g.EnableInMemoryDataTransfer(enable_in_memory_data_transfer); // Enable or disable datablock feature of gnuplot
+	g.SetTitle("example\\_boxplot");
+	g.SetXRange(-0.5, 3.5);
+	g.SetYRange(-3, 6);
+	g.PlotBoxes(groups, plot::x = labels, plot::title = "samples", plot::boxwidth = 0.5,
+				plot::fillcolor = "royalblue", plot::fillsolid = 0.4, plot::color = "black");
+	return 0;
+}
+
+#endif
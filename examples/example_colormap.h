@@ -37,15 +37,14 @@ int example_colormap(const std::string output_filename="example_colormap.png", c
 	adapt::Matrix<double> m(100, 100);
 	std::pair<double, double> xrange = { -9.9, 9.9 };
 	std::pair<double, double> yrange = { -9.9, 9.9 };
-	for (int iy = -50; iy < 50; ++iy)
+	//Generate/ParallelGenerate call the function with the indices of each cell and store the result.
+	//ParallelGenerate splits the rows across threads, so the function must be safe to call concurrently.
+	m.ParallelGenerate([](uint32_t ix, uint32_t iy)
 	{
-		double y = iy * 0.2 + 0.1;
-		for (int ix = -50; ix < 50; ++ix)
-		{
-			double x = ix * 0.2 + 0.1;
-			m[ix + 50][iy + 50] = potential(x, y);
-		}
-	}
+		double x = ((int)ix - 50) * 0.2 + 0.1;
+		double y = ((int)iy - 50) * 0.2 + 0.1;
+		return potential(x, y);
+	});
 	std::vector<double> xfrom(441), yfrom(441), xlen(441), ylen(441);
 	std::vector<double> arrowcolor(441);
 	for (int iy = -10; iy <= 10; ++iy)
@@ -70,6 +69,8 @@ int example_colormap(const std::string output_filename="example_colormap.png", c
 	/* options for Colormap
 	title           ... title.
 	axis            ... set of axes to scale lines. (e.g. plot::axis = "x1y2")
+	downsample      ... shrink a map larger than the output image to its resolution. (e.g. plot::downsample = ResampleMethod::max)
+	skip_value      ... write only the cells whose value differs from this one, over a single background. (e.g. plot::skip_value = 0)
 
 	//contour options
 	with_contour    ... plot contour
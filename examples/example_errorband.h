@@ -0,0 +1,57 @@
+#ifndef EXAMPLE_ERRORBAND_H
+#define EXAMPLE_ERRORBAND_H
+
+#include <ADAPT/GPM2/GPMCanvas.h>
+#include <random>
+
+using namespace adapt::gpm2;
+
+int example_errorband(const std::string output_filename = "example_errorband.png", const bool enable_in_memory_data_transfer = false)
+{
+	//Each thread accumulates the statistics of its own random walks without locks,
+	//and only the accumulators are kept (the raw samples are discarded).
+	const size_t nsteps = 200;
+	const size_t nwalks = 20000;
+	adapt::PerThreadAccumulator<std::vector<adapt::OnlineStatistics>> acc(adapt::GetNumThreads(),
+																		  std::vector<adapt::OnlineStatistics>(nsteps));
+	adapt::ParallelFor(0, nwalks, [&acc, nsteps](size_t b, size_t e, size_t t)
+	{
+		std::mt19937_64 mt(b);
+		std::normal_distribution<> nd(0.02, 1.);
+		auto& stats = acc[t];
+		for (size_t i = b; i < e; ++i)
+		{
+			double pos = 0.;
+			for (size_t s = 0; s < nsteps; ++s)
+			{
+				pos += nd(mt);
+				stats[s].Add(pos);
+			}
+		}
+	}, 1000);
+	std::vector<adapt::OnlineStatistics> stats = acc.Reduce();
+	std::vector<double> x(nsteps);
+	for (size_t s = 0; s < nsteps; ++s) x[s] = (double)(s + 1);
+
+	/*
+	PlotErrorBand(const std::vector<double>& x, const std::vector<OnlineStatistics>& stats, Options ...options)
+	the mean of stats is drawn as a line, and the area of mean +- nsigma * standard deviation is filled.
+	 * options for ErrorBand
+	title          ... title of the mean line.
+	linetype, linewidth, color ... style of the mean line.
+	fillpattern, fillsolid, filltransparent, fillcolor, bordercolor, bordertype ... style of the band.
+	nsigma         ... half width of the band in the unit of the standard deviation. (1 by default)
+	*/
+
+	GPMCanvas2D g(output_filename);
+	g.ShowCommands(true);
+	g.EnableInMemoryDataTransfer(enable_in_memory_data_transfer); // Enable or disable datablock feature of gnuplot
+	g.SetTitle("example\\_errorband");
+	g.SetXLabel("step");
+	g.SetYLabel("position");
+	g.PlotErrorBand(x, stats, plot::title = "mean +- 2{/Symbol s}", plot::nsigma = 2., plot::color = "forest-green", plot::fillsolid = 0.2).
+		PlotErrorBand(x, stats, plot::title = "mean +- {/Symbol s}", plot::color = "dark-green", plot::linewidth = 2.);
+	return 0;
+}
+
+#endif
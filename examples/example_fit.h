@@ -0,0 +1,52 @@
+#ifndef EXAMPLE_FIT_H
+#define EXAMPLE_FIT_H
+
+#include <ADAPT/GPM2/GPMCanvas.h>
+#include <random>
+
+using namespace adapt::gpm2;
+
+int example_fit(const std::string output_filename = "example_fit.png", const bool enable_in_memory_data_transfer = false)
+{
+	std::mt19937_64 mt(0);
+	std::normal_distribution<> nd(0., 0.1);
+	std::vector<double> x(200), y(200), e(200);
+	for (size_t i = 0; i < x.size(); ++i)
+	{
+		x[i] = i * 0.05;
+		e[i] = 0.05 + 0.01 * x[i];
+		y[i] = 3. * std::exp(-0.4 * x[i]) * std::cos(2. * x[i]) + 0.5 + nd(mt) * e[i] * 10.;
+	}
+
+	/*
+	1. FitPolynomial(const std::vector<double>& x, const std::vector<double>& y, int degree, Options ...options)
+	2. FitLinear(const std::vector<double>& x, const std::vector<double>& y, const GPMLinearModel& model, Options ...options)
+	3. FitNonlinear(const std::vector<double>& x, const std::vector<double>& y, const GPMNonlinearModel& model,
+	                const std::vector<double>& init, Options ...options)
+	the least squares fit is performed in C++ (Levenberg-Marquardt for nonlinear models) with multiple threads.
+	GetEquation() of the result returns a gnuplot expression in which the parameters are replaced with fitted values.
+	 * options for Fit
+	yerrorbar ... standard deviations of y. each point is weighted by 1/yerrorbar^2.
+	maxiter   ... maximum number of iterations for nonlinear fits.
+	tolerance ... the fit stops when the relative change of chi^2 becomes smaller than this value.
+	*/
+
+	GPMNonlinearModel model([](double x, const double* a) { return a[0] * std::exp(-a[1] * x) * std::cos(a[2] * x) + a[3]; },
+							"A*exp(-k*x)*cos(w*x)+c", { "A", "k", "w", "c" });
+	GPMFitResult result = FitNonlinear(x, y, model, { 2., 0.5, 1.8, 0. }, fit::yerrorbar = e);
+	GPMFitResult line = FitPolynomial(x, y, 1, fit::yerrorbar = e);
+
+	GPMCanvas2D g(output_filename);
+	g.ShowCommands(true);
+	g.EnableInMemoryDataTransfer(enable_in_memory_data_transfer); // Enable or disable datablock feature of gnuplot
+	g.SetTitle("example\\_fit");
+	g.SetXLabel("x");
+	g.SetYLabel("y");
+	g.PlotPoints(x, y, plot::yerrorbar = e, plot::title = "data", plot::pointtype = 7, plot::pointsize = 0.5).
+		PlotLines(result.GetEquation(), plot::title = adapt::Format("fit (chi^2/ndf = %.2f)", result.GetReducedChiSquare()),
+				  plot::linewidth = 2., plot::color = "red").
+		PlotLines(line.GetEquation(), plot::title = "linear", plot::color = "blue");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef EXAMPLE_MEMORY_H
+#define EXAMPLE_MEMORY_H
+
+#include <ADAPT/GPM2/GPMCanvas.h>
+#include <fstream>
+#include <cmath>
+
+using namespace adapt::gpm2;
+
+int example_memory(const std::string output_filename = "example_memory.png", const bool enable_in_memory_data_transfer = false)
+{
+	/*
+	GPMImageSink(const std::string& command)
+	runs gnuplot and collects the image written to its stdout, instead of letting gnuplot write the output file.
+	Give it to the constructor of a canvas. The extension of the output name selects the terminal (png, svg, eps, pdf).
+	GetImage() returns a std::shared_future<std::vector<std::byte>>, which becomes ready when the canvas is destroyed.
+	*/
+
+	std::vector<double> x(200), y(200);
+	for (size_t i = 0; i < x.size(); ++i)
+	{
+		x[i] = i * 0.05;
+		y[i] = std::sin(x[i]) * std::exp(-x[i] / 5.);
+	}
+
+	auto sink = std::make_shared<GPMImageSink>(GPMCanvas::GetGnuplotPath());
+	std::shared_future<GPMImageSink::Image> image = sink->GetImage();
+	{
+		GPMCanvas2D g(output_filename, std::move(sink));
+		g.EnableInMemoryDataTransfer(enable_in_memory_data_transfer); // Enable or disable datablock feature of gnuplot
+		g.SetTitle("example\\_memory");
+		g.PlotLines(x, y, plot::title = "damped oscillation");
+	}
+
+	//The bytes can be sent anywhere, e.g. as an HTTP response. Here they are simply saved.
+	const std::vector<std::byte>& bytes = image.get();
+	std::ofstream ofs(output_filename, std::ios::binary);
+	ofs.write(reinterpret_cast<const char*>(bytes.data()), (std::streamsize)bytes.size());
+	return 0;
+}
+
+#endif
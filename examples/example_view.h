@@ -0,0 +1,55 @@
+#ifndef EXAMPLE_VIEW_H
+#define EXAMPLE_VIEW_H
+
+#include <ADAPT/GPM2/GPMCanvas.h>
+#include <cmath>
+
+using namespace adapt::gpm2;
+
+int example_view(const std::string output_filename = "example_view.png")
+{
+	/*
+	MatrixView<T, Dim> refers to a part of a Matrix without copying it.
+	Slice(dim, begin, end, step), Transpose(), Reverse(dim), Row(i) and Column(j) return new views of the same elements.
+	PlotColormap accepts MatrixView<const double, 2>, and PlotPoints / PlotLines accept MatrixView<const double, 1>,
+	so the elements are written to gnuplot directly from the original Matrix.
+	A view must not outlive the Matrix, and becomes invalid when the Matrix is resized.
+
+	For grids larger than memory, save them with SaveMatrix("grid.bin", m) (ADAPT/CUF/MappedMatrix.h)
+	and open them with MappedMatrix<double, 3> grid("grid.bin").
+	grid.GetView().Fix(2, k) is then the k-th xy plane, and only the pages it touches are read from the file.
+	*/
+
+	adapt::Matrix<double> m(200, 200);
+	for (uint32_t ix = 0; ix < 200; ++ix)
+	{
+		double x = -10. + ix * 0.1;
+		for (uint32_t iy = 0; iy < 200; ++iy)
+		{
+			double y = -10. + iy * 0.1;
+			m[ix][iy] = std::sin(x) * std::cos(y) * std::exp(-(x * x + y * y) / 50.);
+		}
+	}
+	adapt::MatrixView<const double> view = m;
+	std::vector<double> x(200);
+	for (uint32_t i = 0; i < 200; ++i) x[i] = -10. + i * 0.1;
+
+	GPMMultiPlot multi(output_filename, 1, 2, 1200, 600);
+	{
+		GPMCanvasCM g("example_view_tmpfile");
+		g.SetTitle("x, y in [0, 10)");
+		g.SetCBRange(-1, 1);
+		std::pair<double, double> range = { 0., 9.9 };
+		g.PlotColormap(view.Slice(0, 100, 200).Slice(1, 100, 200), range, range, plot::title = "notitle");
+	}
+	{
+		GPMCanvas2D g("example_view_tmpfile");
+		g.SetTitle("profiles");
+		g.SetYRange(-1, 1);
+		g.PlotLines(x, view.Column(100), plot::title = "y = 0").
+			PlotLines(x, view.Row(115), plot::title = "x = 1.5");
+	}
+	return 0;
+}
+
+#endif
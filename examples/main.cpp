@@ -3,6 +3,12 @@
 #include "example_filledcurve.h"
 #include "example_string.h"
 #include "example_for_loop.h"
+#include "example_fit.h"
+#include "example_boxplot.h"
+#include "example_errorband.h"
+#include "example_memory.h"
+#include "example_animation.h"
+#include "example_view.h"
 
 int main()
 {
@@ -11,6 +17,12 @@ int main()
 	//1. Call function "GPMCanvas::SetGnuplotPath("path to gnuplot")".
 	//2. Define environment variable "GNUPLOT_PATH=path to gnuplot".
 
+	//To record the command streams instead of drawing immediately, call "GPMCanvas::SetScriptDirectory("dir")" here.
+	//Every canvas then writes "dir/<output>.gp" (and its data files), and "GPMCanvas::RenderScripts("dir")" renders them later.
+	//More generally, "GPMCanvas::SetSinkFactory" redirects the command streams to any GPMCommandSink,
+	//e.g. GPMMemorySink to inspect them or GPMNullSink to run without gnuplot.
+	//"GPMCanvas::EnableRenderCache(true)" skips gnuplot for images whose commands and data are unchanged since the last run.
+
 	example_2d();
 
 	example_colormap();
@@ -21,6 +33,18 @@ int main()
 
 	example_for_loop();
 
+	example_fit();
+
+	example_boxplot();
+
+	example_errorband();
+
+	example_memory();
+
+	example_animation();
+
+	example_view();
+
 	//The following are tests for in-memory data transfer (datablock feature).
 	//Non-alphanumeric characters are intentionally used to test SanitizeForDataBlock().
 	example_2d("example_2d-inmemory.png", true);
@@ -0,0 +1,58 @@
+#include <ADAPT/CUF/Matrix.h>
+#include <complex>
+#include <cstdio>
+
+//Matrixの演算子の結果を確かめる。失敗した項目を表示し、1つでも失敗すれば1を返す。
+
+namespace
+{
+
+int gFailures = 0;
+
+void Check(bool ok, const char* what)
+{
+	if (ok) return;
+	std::printf("FAILED: %s\n", what);
+	++gFailures;
+}
+
+}
+
+int main()
+{
+	using namespace adapt;
+
+	Matrix<double> a(2, 2, 1.);
+	Matrix<double> b(2, 2, 2.);
+	Matrix<double> c(2, 2, 3.);
+	Vector<double> v(2, 1.);
+
+	//式を含む行列積。
+	Matrix<double> p = (a + b) * c;
+	Check(p[0][0] == 18. && p[0][1] == 18. && p[1][0] == 18. && p[1][1] == 18., "(a + b) * c");
+	Matrix<double> q = c * (b - a);
+	Check(q[0][0] == 6. && q[1][1] == 6., "c * (b - a)");
+	Vector<double> w = (a - b) * v;
+	Check(w[0] == -2. && w[1] == -2., "(a - b) * v");
+	Vector<double> u = a * (v + v);
+	Check(u[0] == 4. && u[1] == 4., "a * (v + v)");
+
+	//スカラーは要素の型に変換してから演算する。
+	Matrix<int> m(2, 2, 3);
+	Matrix<int> r = m * 2.5;
+	Check(r[0][0] == 6 && r[1][1] == 6, "Matrix<int> * 2.5");
+	Matrix<int> s = 2.5 * m;
+	Check(s[0][0] == 6, "2.5 * Matrix<int>");
+	Matrix<double> d = 6. / c;
+	Check(d[0][0] == 2., "6 / c");
+
+	//算術型以外の要素でも、要素の型へ変換できるものはスカラーとして扱う。
+	Matrix<std::complex<double>> z(2, 2, std::complex<double>(1., 1.));
+	Matrix<std::complex<double>> zi = z * std::complex<double>(0., 1.);
+	Check(zi[0][0] == std::complex<double>(-1., 1.) && zi[1][1] == std::complex<double>(-1., 1.), "Matrix<complex> * complex");
+	Matrix<std::complex<double>> zd = 2. * z - std::complex<double>(1., 0.);
+	Check(zd[0][1] == std::complex<double>(1., 2.), "2 * Matrix<complex> - complex");
+
+	if (gFailures == 0) std::printf("all tests passed\n");
+	return gFailures == 0 ? 0 : 1;
+}